@@ -0,0 +1,255 @@
+#include "Diff.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Results.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace Diff {
+  namespace {
+    typedef std::vector<Utils::RankedReplacement> RankedFixes;
+
+    // Lines of context around each change.
+    const unsigned Context = 3;
+
+    std::mutex Lock;
+    std::unique_ptr<raw_fd_ostream> Out;
+    std::string Root;
+    std::vector<std::string> Rules;
+    const IncludeGraph *Graph = nullptr;
+    // Replacements of the files that have not been diffed yet.
+    std::map<std::string, RankedFixes> Pending;
+    // How many TUs still to run include each file.
+    std::map<std::string, unsigned> Remaining;
+
+    // A run of changed lines: the old lines [First, Last] become New.
+    struct Change {
+      unsigned First;
+      unsigned Last;
+      std::string New;
+    };
+
+    unsigned countLines(StringRef Text) {
+      return Text.count('\n') + (!Text.empty() && !Text.endswith("\n"));
+    }
+
+    void writeLines(raw_ostream &OS, char Prefix, StringRef Text) {
+      while (!Text.empty()) {
+        std::pair<StringRef, StringRef> Line = Text.split('\n');
+        OS << Prefix << Line.first << "\n";
+        if (Line.first.size() == Text.size())
+          OS << "\\ No newline at end of file\n";
+        Text = Line.second;
+      }
+    }
+
+    void writeDiff(raw_ostream &OS, StringRef File, StringRef Code,
+                   const Replacements &Fixes) {
+      if (Fixes.empty())
+        return;
+
+      std::vector<size_t> Starts(1, 0);
+      for (size_t I = 0; I < Code.size(); ++I) {
+        if (Code[I] == '\n' && I + 1 < Code.size())
+          Starts.push_back(I + 1);
+      }
+      unsigned NumLines = Code.empty() ? 0 : Starts.size();
+      auto LineOf = [&](size_t Offset) {
+        return unsigned(std::upper_bound(Starts.begin(), Starts.end(), Offset) - Starts.begin() - 1);
+      };
+      auto LineEnd = [&](unsigned Line) {
+        return Line + 1 < Starts.size() ? Starts[Line + 1] : Code.size();
+      };
+      auto Text = [&](unsigned First, unsigned Last) {
+        return Code.slice(Starts[First], LineEnd(Last));
+      };
+
+      // Replacements are sorted and do not overlap; ones that touch the
+      // same lines become one change.
+      std::vector<Change> Changes;
+      std::vector<const Replacement *> Group;
+      auto Flush = [&] {
+        Change C;
+        C.First = LineOf(Group.front()->getOffset());
+        C.Last = C.First;
+        size_t Pos = Starts[C.First];
+        for (const Replacement *R : Group) {
+          size_t End = R->getOffset() + R->getLength();
+          if (R->getLength())
+            C.Last = std::max(C.Last, LineOf(End - 1));
+          C.New += Code.slice(Pos, R->getOffset()).str() + R->getReplacementText().str();
+          Pos = End;
+        }
+        C.New += Code.slice(Pos, LineEnd(C.Last)).str();
+        Changes.push_back(C);
+        Group.clear();
+      };
+      for (const Replacement &R : Fixes) {
+        unsigned First = LineOf(R.getOffset());
+        if (!Group.empty()) {
+          const Replacement *Prev = Group.back();
+          unsigned PrevLast = LineOf(Prev->getOffset() + (Prev->getLength() ? Prev->getLength() - 1 : 0));
+          if (First > PrevLast)
+            Flush();
+        }
+        Group.push_back(&R);
+      }
+      Flush();
+
+      if (!Root.empty() && File.startswith(Root + "/")) {
+        StringRef Relative = File.substr(Root.size() + 1);
+        OS << "--- a/" << Relative << "\n+++ b/" << Relative << "\n";
+      } else {
+        OS << "--- " << File << "\n+++ " << File << "\n";
+      }
+
+      int Delta = 0;
+      for (size_t I = 0; I < Changes.size();) {
+        // Changes closer than twice the context share a hunk.
+        size_t J = I + 1;
+        while (J < Changes.size() && Changes[J].First <= Changes[J - 1].Last + 2 * Context + 1)
+          ++J;
+        unsigned Start = Changes[I].First > Context ? Changes[I].First - Context : 0;
+        unsigned End = NumLines ? std::min(NumLines - 1, Changes[J - 1].Last + Context) : 0;
+        unsigned OldCount = NumLines ? End - Start + 1 : 0;
+        int NewCount = OldCount;
+        for (size_t K = I; K < J; ++K)
+          NewCount += int(countLines(Changes[K].New)) -
+                      int(NumLines ? Changes[K].Last - Changes[K].First + 1 : 0);
+
+        OS << "@@ -" << (OldCount ? Start + 1 : Start) << "," << OldCount << " +"
+           << (NewCount ? int(Start) + Delta + 1 : int(Start) + Delta) << "," << NewCount
+           << " @@\n";
+        unsigned Line = Start;
+        for (size_t K = I; K < J; ++K) {
+          if (Line < Changes[K].First)
+            writeLines(OS, ' ', Text(Line, Changes[K].First - 1));
+          if (NumLines)
+            writeLines(OS, '-', Text(Changes[K].First, Changes[K].Last));
+          writeLines(OS, '+', Changes[K].New);
+          Line = Changes[K].Last + 1;
+        }
+        if (NumLines && Line <= End)
+          writeLines(OS, ' ', Text(Line, End));
+
+        Delta += NewCount - int(OldCount);
+        I = J;
+      }
+    }
+
+    // Called with Lock held.
+    void diffFile(const std::string &File) {
+      std::map<std::string, RankedFixes>::iterator Fixes = Pending.find(File);
+      if (Fixes == Pending.end())
+        return;
+      std::map<std::string, Replacements> Merged;
+      std::vector<Utils::RankedReplacement> Accepted;
+      Utils::MergeReplacements(std::move(Fixes->second), Merged, errs(), &Accepted);
+      Pending.erase(Fixes);
+      Results::addReplacements(Accepted);
+
+      ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer = MemoryBuffer::getFile(File);
+      if (!Buffer) {
+        errs() << "diff: cannot read " << File << ": " << Buffer.getError().message() << "\n";
+        return;
+      }
+      for (const auto &Entry : Merged)
+        writeDiff(*Out, File, (*Buffer)->getBuffer(), Entry.second);
+      Out->flush();
+    }
+
+    void add(const Utils::RankedReplacement &Fix) {
+      std::string File = Utils::NormalizePath(Fix.Fix.getFilePath());
+      Utils::RankedReplacement Ranked = Fix;
+      Ranked.Fix = Replacement(File, Fix.Fix.getOffset(), Fix.Fix.getLength(),
+                               Fix.Fix.getReplacementText());
+      Pending[File].push_back(Ranked);
+    }
+  }
+
+  bool open(StringRef Path, StringRef RootDir) {
+    std::error_code EC;
+    Out.reset(new raw_fd_ostream(Path, EC, sys::fs::F_Text));
+    if (EC) {
+      errs() << "diff: cannot write " << Path << ": " << EC.message() << "\n";
+      Out.reset();
+      return false;
+    }
+    if (!RootDir.empty())
+      Root = Utils::NormalizePath(RootDir);
+    return true;
+  }
+
+  bool enabled() {
+    return Out != nullptr;
+  }
+
+  void stream(const IncludeGraph &Includes, const std::vector<std::string> &TUs,
+              const std::vector<std::string> &RuleOrder) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Graph = &Includes;
+    Rules = RuleOrder;
+    for (const std::string &TU : TUs) {
+      if (const IncludeGraph::TranslationUnit *Info = Graph->lookup(Utils::NormalizePath(TU))) {
+        for (const std::string &File : Info->Files)
+          ++Remaining[File];
+      }
+    }
+  }
+
+  void finishTU(StringRef TU, bool Failed) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    std::vector<Utils::StagedReplacement> &Staged = Utils::StagedReplacements();
+    if (!Failed) {
+      for (const Utils::StagedReplacement &S : Staged) {
+        unsigned Rank = std::find(Rules.begin(), Rules.end(), S.Rule) - Rules.begin();
+        Utils::RankedReplacement Fix = { S.Fix, Rank, S.Rule, S.Ifdef, S.Guarded };
+        add(Fix);
+      }
+    }
+    Staged.clear();
+
+    const IncludeGraph::TranslationUnit *Info =
+        Graph ? Graph->lookup(Utils::NormalizePath(TU)) : nullptr;
+    if (!Info)
+      return;
+    for (const std::string &File : Info->Files) {
+      std::map<std::string, unsigned>::iterator Count = Remaining.find(File);
+      if (Count == Remaining.end() || --Count->second)
+        continue;
+      Remaining.erase(Count);
+      diffFile(File);
+    }
+  }
+
+  void addReplacements(const std::vector<Utils::RankedReplacement> &Fixes) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    for (const Utils::RankedReplacement &Fix : Fixes)
+      add(Fix);
+  }
+
+  bool close() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Out)
+      return true;
+    while (!Pending.empty())
+      diffFile(Pending.begin()->first);
+    Out->close();
+    bool Failed = Out->has_error();
+    if (Failed)
+      Out->clear_error();
+    Out.reset();
+    return !Failed;
+  }
+}
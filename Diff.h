@@ -0,0 +1,50 @@
+//===- Diff.h - Unified diffs instead of in-place edits -------------------===//
+//
+//  With -diff, rewritten files are not written back; a unified diff of each
+//  of them is written instead. Replacements are taken from the staging area
+//  as each TU finishes and kept per file. Once no TU still to run includes
+//  a file, according to the include graph, its replacements are final: the
+//  file is diffed and forgotten, so only files still in flux are held in
+//  memory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_DIFF_H
+#define QT4TO5_DIFF_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "IncludeGraph.h"
+#include "Utils.h"
+
+namespace Diff {
+  // Opens Path ("-" for stdout). Paths under Root are written relative to
+  // it, as a/<path> and b/<path>, so the diff applies with patch -p1.
+  bool open(llvm::StringRef Path, llvm::StringRef Root);
+  bool enabled();
+
+  // Diffs files as soon as none of TUs that are still to run includes them.
+  // Graph must cover TUs. RuleOrder ranks conflicting replacements as in
+  // Utils::MergeStaged. Without a call to this, everything is diffed in
+  // close().
+  void stream(const IncludeGraph &Graph, const std::vector<std::string> &TUs,
+              const std::vector<std::string> &RuleOrder);
+
+  // Takes the replacements TU staged, or drops them if it failed, and diffs
+  // the files that are final now.
+  void finishTU(llvm::StringRef TU, bool Failed);
+
+  // Diffs Fixes, e.g. the merged fixes of shards or workers.
+  void addReplacements(const std::vector<Utils::RankedReplacement> &Fixes);
+
+  // Diffs the files that are left and closes the output. Returns false on
+  // I/O errors.
+  bool close();
+}
+
+#endif
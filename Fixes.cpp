@@ -0,0 +1,132 @@
+#include "Fixes.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+
+namespace {
+// A replacement as it is written: the fields of clang's Replacement plus
+// the rule that made it, its rank and what -results needs to know of it.
+struct FixEntry {
+  FixEntry() : Offset(0), Length(0), Priority(0), Ifdef(false), Guarded(false) {}
+
+  std::string FilePath;
+  unsigned Offset;
+  unsigned Length;
+  std::string ReplacementText;
+  std::string Rule;
+  unsigned Priority;
+  bool Ifdef;
+  bool Guarded;
+};
+
+struct FixesFile {
+  FixesFile() : Complete(true) {}
+
+  std::string MainSourceFile;
+  // False if some TU failed, so that not everything was matched.
+  bool Complete;
+  std::vector<FixEntry> Replacements;
+};
+} // end namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(FixEntry)
+
+namespace llvm {
+namespace yaml {
+template <> struct MappingTraits<FixEntry> {
+  static void mapping(IO &IO, FixEntry &Fix) {
+    IO.mapRequired("FilePath", Fix.FilePath);
+    IO.mapRequired("Offset", Fix.Offset);
+    IO.mapRequired("Length", Fix.Length);
+    IO.mapRequired("ReplacementText", Fix.ReplacementText);
+    IO.mapOptional("Rule", Fix.Rule, std::string());
+    IO.mapOptional("Priority", Fix.Priority, 0u);
+    IO.mapOptional("Ifdef", Fix.Ifdef, false);
+    IO.mapOptional("Guarded", Fix.Guarded, false);
+  }
+};
+
+template <> struct MappingTraits<FixesFile> {
+  static void mapping(IO &IO, FixesFile &File) {
+    IO.mapRequired("MainSourceFile", File.MainSourceFile);
+    IO.mapOptional("Complete", File.Complete, true);
+    IO.mapRequired("Replacements", File.Replacements);
+  }
+};
+} // end namespace yaml
+} // end namespace llvm
+
+bool writeFixes(StringRef Path, StringRef MainSourceFile,
+                const std::vector<Utils::RankedReplacement> &Fixes,
+                bool Complete, raw_ostream &Errors) {
+  FixesFile File;
+  File.MainSourceFile = MainSourceFile;
+  File.Complete = Complete;
+  for (const Utils::RankedReplacement &Fix : Fixes) {
+    FixEntry Entry;
+    Entry.FilePath = Fix.Fix.getFilePath();
+    Entry.Offset = Fix.Fix.getOffset();
+    Entry.Length = Fix.Fix.getLength();
+    // A single line break in a quoted scalar reads back as a space; a
+    // doubled one reads back as one line break. clang's own
+    // ReplacementsYaml.h does the same.
+    for (char C : Fix.Fix.getReplacementText())
+      Entry.ReplacementText += C == '\n' ? "\n\n" : std::string(1, C);
+    Entry.Rule = Fix.Rule;
+    Entry.Priority = Fix.Priority;
+    Entry.Ifdef = Fix.Ifdef;
+    Entry.Guarded = Fix.Guarded;
+    File.Replacements.push_back(Entry);
+  }
+
+  SmallString<256> Partial(Path);
+  Partial += ".partial";
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(Partial, EC, sys::fs::F_Text);
+    if (EC) {
+      Errors << "fixes: cannot write " << Partial << ": " << EC.message() << "\n";
+      return false;
+    }
+    yaml::Output YAML(OS);
+    YAML << File;
+  }
+
+  if (std::error_code EC = sys::fs::rename(Partial, Path)) {
+    Errors << "fixes: cannot rename " << Partial << ": " << EC.message() << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool readFixes(StringRef Path, std::vector<Utils::RankedReplacement> &Fixes,
+               raw_ostream &Errors, bool *Complete) {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    Errors << "fixes: cannot read " << Path << "\n";
+    return false;
+  }
+
+  FixesFile File;
+  yaml::Input YAML((*Buffer)->getBuffer());
+  YAML >> File;
+  if (YAML.error()) {
+    Errors << "fixes: cannot parse " << Path << "\n";
+    return false;
+  }
+  for (const FixEntry &Entry : File.Replacements) {
+    Utils::RankedReplacement Fix = {
+      Replacement(Entry.FilePath, Entry.Offset, Entry.Length, Entry.ReplacementText),
+      Entry.Priority, Entry.Rule, Entry.Ifdef, Entry.Guarded
+    };
+    Fixes.push_back(Fix);
+  }
+  if (Complete)
+    *Complete = File.Complete;
+  return true;
+}
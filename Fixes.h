@@ -0,0 +1,37 @@
+//===- Fixes.h - Replacements exchanged through files ---------------------===//
+//
+//  Shards and worker processes hand their replacements to the process that
+//  applies them through YAML fixes files. The layout is that of clang's
+//  TranslationUnitReplacements (as written by clang-tidy -export-fixes), and
+//  each replacement also records the rule that made it and that rule's
+//  rank, so that conflicts are decided as in a single process, and whether
+//  it is an #if line or was made along with one, for -results.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_FIXES_H
+#define QT4TO5_FIXES_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Utils.h"
+
+// Writes Fixes to Path. Complete is false if some TU failed, so that Fixes
+// may lack what it would have matched. The file appears under its final
+// name only once it is written.
+bool writeFixes(llvm::StringRef Path, llvm::StringRef MainSourceFile,
+                const std::vector<Utils::RankedReplacement> &Fixes,
+                bool Complete, llvm::raw_ostream &Errors);
+
+// Appends the replacements in Path to Fixes and sets Complete, if given, to
+// what the writer recorded. Files without rules, such as those of
+// clang-tidy, read as rank 0 and complete.
+bool readFixes(llvm::StringRef Path,
+               std::vector<Utils::RankedReplacement> &Fixes,
+               llvm::raw_ostream &Errors, bool *Complete = nullptr);
+
+#endif
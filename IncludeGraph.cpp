@@ -0,0 +1,146 @@
+#include "IncludeGraph.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "Trace.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace {
+class CollectIncludesAction : public PreprocessOnlyAction {
+ public:
+  CollectIncludesAction(IncludeGraph::TranslationUnit *TU) : TU(TU) {}
+
+ protected:
+  virtual void EndSourceFileAction() {
+    SourceManager &SM = getCompilerInstance().getSourceManager();
+    for (SourceManager::fileinfo_iterator I = SM.fileinfo_begin(),
+                                          E = SM.fileinfo_end();
+         I != E; ++I) {
+      // Relative names are relative to the command's directory, not ours.
+      SmallString<256> Path(I->first->getName());
+      SM.getFileManager().makeAbsolutePath(Path);
+      TU->Files.insert(Utils::NormalizePath(Path));
+
+      const llvm::MemoryBuffer *Buffer = I->second->getRawBuffer();
+      if (Buffer)
+        TU->PreprocessedLines +=
+            std::count(Buffer->getBufferStart(), Buffer->getBufferEnd(), '\n');
+    }
+  }
+
+ private:
+  IncludeGraph::TranslationUnit *TU;
+};
+} // end namespace
+
+IncludeGraph::IncludeGraph(
+    const clang::tooling::CompilationDatabase &Compilations, unsigned Jobs)
+    : IncludeGraph(Compilations, Compilations.getAllFiles(), Jobs) {}
+
+IncludeGraph::IncludeGraph(
+    const clang::tooling::CompilationDatabase &Compilations,
+    const std::vector<std::string> &Files, unsigned Jobs) {
+  std::mutex Lock;
+  ThreadPool Pool(Jobs);
+
+  for (const std::string &File : Files) {
+    Pool.async([&, File] {
+      Trace::Scope Span("Preprocess", File);
+      TranslationUnit TU;
+      IgnoringDiagConsumer Ignore;
+      for (const tooling::CompileCommand &Command :
+           Compilations.getCompileCommands(File)) {
+        Utils::RunOnCommand(Command, new CollectIncludesAction(&TU),
+                            tooling::getClangStripOutputAdjuster(), &Ignore);
+      }
+      TU.Files.insert(Utils::NormalizePath(File));
+
+      std::lock_guard<std::mutex> Guard(Lock);
+      TUs[Utils::NormalizePath(File)] = TU;
+    });
+  }
+  Pool.wait();
+}
+
+std::vector<std::string>
+IncludeGraph::affectedBy(const std::set<std::string> &Files) const {
+  std::vector<std::string> Result;
+  for (const auto &TU : TUs) {
+    for (const std::string &File : Files) {
+      if (TU.second.Files.count(File)) {
+        Result.push_back(TU.first);
+        break;
+      }
+    }
+  }
+  return Result;
+}
+
+const IncludeGraph::TranslationUnit *
+IncludeGraph::lookup(const std::string &TU) const {
+  std::map<std::string, TranslationUnit>::const_iterator I = TUs.find(TU);
+  return I == TUs.end() ? nullptr : &I->second;
+}
+
+unsigned long long
+IncludeGraph::preprocessedLines(const std::vector<std::string> &TUs) const {
+  unsigned long long Lines = 0;
+  for (const std::string &TU : TUs) {
+    if (const TranslationUnit *Info = lookup(TU))
+      Lines += Info->PreprocessedLines;
+  }
+  return Lines;
+}
+
+void addRewrittenFiles(
+    const std::map<std::string, tooling::Replacements> &Replacements,
+    const std::string &Rule, RewrittenFiles &Files) {
+  for (const auto &Entry : Replacements) {
+    if (Entry.second.empty())
+      continue;
+    std::set<std::string> &Rules = Files[Utils::NormalizePath(Entry.first)];
+    auto Recorded = Utils::ReplacementRules().find(Entry.first);
+    if (Recorded != Utils::ReplacementRules().end())
+      Rules.insert(Recorded->second.begin(), Recorded->second.end());
+    else
+      Rules.insert(Rule);
+  }
+}
+
+void reportRebuildImpact(const IncludeGraph &Graph, const RewrittenFiles &Files,
+                         raw_ostream &OS) {
+  std::map<std::string, std::set<std::string> > FilesByRule;
+  for (const auto &File : Files) {
+    for (const std::string &Rule : File.second)
+      FilesByRule[Rule].insert(File.first);
+  }
+
+  for (const auto &Rule : FilesByRule) {
+    std::vector<std::string> TUs = Graph.affectedBy(Rule.second);
+    OS << "impact: " << Rule.first << ": " << Rule.second.size()
+       << " files rewritten, " << TUs.size() << " TUs and "
+       << Graph.preprocessedLines(TUs) << " preprocessed lines to recompile\n";
+
+    // Per file, so that the headers which fan out the most stand out.
+    std::vector<std::pair<size_t, std::string> > ByFanOut;
+    for (const std::string &File : Rule.second) {
+      std::set<std::string> Single;
+      Single.insert(File);
+      ByFanOut.push_back(std::make_pair(Graph.affectedBy(Single).size(), File));
+    }
+    std::sort(ByFanOut.rbegin(), ByFanOut.rend());
+    for (const auto &File : ByFanOut)
+      OS << "impact:   " << File.first << " TUs  " << File.second << "\n";
+  }
+}
@@ -0,0 +1,67 @@
+//===- IncludeGraph.h - Files pulled in by each translation unit ----------===//
+//
+//  Preprocesses translation units from a compilation database and records
+//  which files each of them includes, so that the set of TUs that has to be
+//  recompiled after a file is rewritten can be computed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_INCLUDEGRAPH_H
+#define QT4TO5_INCLUDEGRAPH_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/raw_ostream.h"
+
+class IncludeGraph {
+ public:
+  struct TranslationUnit {
+    TranslationUnit() : PreprocessedLines(0) {}
+
+    // Every file entered while preprocessing, the main file included.
+    std::set<std::string> Files;
+    // Number of source lines the preprocessor had to read for this TU.
+    unsigned PreprocessedLines;
+  };
+
+  // Preprocesses every file in Compilations using up to Jobs threads.
+  IncludeGraph(const clang::tooling::CompilationDatabase &Compilations,
+               unsigned Jobs);
+  // Preprocesses only the TUs in Files.
+  IncludeGraph(const clang::tooling::CompilationDatabase &Compilations,
+               const std::vector<std::string> &Files, unsigned Jobs);
+
+  // Returns the TUs that are, or include, one of Files, in sorted order.
+  std::vector<std::string> affectedBy(const std::set<std::string> &Files) const;
+
+  const TranslationUnit *lookup(const std::string &TU) const;
+
+  // Sums PreprocessedLines over TUs.
+  unsigned long long
+  preprocessedLines(const std::vector<std::string> &TUs) const;
+
+ private:
+  std::map<std::string, TranslationUnit> TUs;
+};
+
+// Maps every rewritten file to the rules that rewrote it.
+typedef std::map<std::string, std::set<std::string> > RewrittenFiles;
+
+// Collects the (normalized) names of the files a replacement set touches,
+// attributing them to the rules Utils::AddReplacement recorded for them, or
+// to Rule for replacements read back from fixes files.
+void addRewrittenFiles(
+    const std::map<std::string, clang::tooling::Replacements> &Replacements,
+    const std::string &Rule, RewrittenFiles &Files);
+
+// Writes, per rule and per rewritten file, how many TUs and preprocessed
+// lines have to be recompiled because of the rewrite.
+void reportRebuildImpact(const IncludeGraph &Graph, const RewrittenFiles &Files,
+                         llvm::raw_ostream &OS);
+
+#endif
@@ -0,0 +1,196 @@
+#include "Memory.h"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <stddef.h>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include "llvm/Support/Format.h"
+
+using namespace llvm;
+
+namespace Memory {
+  namespace {
+    struct Counters {
+      uint64_t Allocated;
+      uint64_t Allocations;
+      // Highest value of Live seen by an allocation on this thread.
+      int64_t Peak;
+      uint64_t ReplacementBytes;
+    };
+
+    // Constant-initialized, so using it from operator new cannot recurse.
+    thread_local Counters Thread;
+    std::atomic<bool> Enabled(false);
+    // Bytes in counted blocks that are not freed yet. Blocks are often
+    // freed on another thread than the one that allocated them (ThreadPool
+    // tasks), so this is kept for the whole process.
+    std::atomic<int64_t> Live(0);
+
+    std::mutex Lock;
+    std::map<std::string, TUStats> TUs;
+    std::map<std::string, RuleStats> Rules;
+  }
+
+  void enable() {
+    Enabled = true;
+  }
+
+  bool enabled() {
+    return Enabled;
+  }
+
+  Phase::Phase()
+      : StartAllocated(Thread.Allocated), StartAllocations(Thread.Allocations),
+        StartLive(Live.load(std::memory_order_relaxed)),
+        OuterPeak(Thread.Peak) {
+    Thread.Peak = StartLive;
+  }
+
+  Phase::~Phase() {
+    if (OuterPeak > Thread.Peak)
+      Thread.Peak = OuterPeak;
+  }
+
+  uint64_t Phase::allocated() const {
+    return Thread.Allocated - StartAllocated;
+  }
+
+  uint64_t Phase::allocations() const {
+    return Thread.Allocations - StartAllocations;
+  }
+
+  uint64_t Phase::peak() const {
+    return Thread.Peak > StartLive ? Thread.Peak - StartLive : 0;
+  }
+
+  void addTU(const std::string &File, const TUStats &Stats) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    TUs[File] = Stats;
+  }
+
+  void addMatch(const std::string &Rule, uint64_t Allocated, uint64_t Peak) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    RuleStats &Stats = Rules[Rule];
+    ++Stats.Matches;
+    Stats.Allocated += Allocated;
+    if (Peak > Stats.Peak)
+      Stats.Peak = Peak;
+  }
+
+  void addReplacement(const std::string &Rule, uint64_t Bytes) {
+    Thread.ReplacementBytes += Bytes;
+    std::lock_guard<std::mutex> Guard(Lock);
+    Rules[Rule].ReplacementBytes += Bytes;
+  }
+
+  uint64_t threadReplacementBytes() {
+    return Thread.ReplacementBytes;
+  }
+
+  std::string formatBytes(uint64_t Bytes) {
+    std::string Result;
+    raw_string_ostream OS(Result);
+    if (Bytes >= 1024 * 1024)
+      OS << format("%.1f MB", Bytes / (1024.0 * 1024.0));
+    else if (Bytes >= 1024)
+      OS << format("%.1f KB", Bytes / 1024.0);
+    else
+      OS << Bytes << " B";
+    return OS.str();
+  }
+
+  void report(raw_ostream &OS) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    for (const auto &TU : TUs) {
+      const TUStats &S = TU.second;
+      OS << "memory: " << TU.first << "\n"
+         << "memory:   parse   " << formatBytes(S.ParseAllocated)
+         << " allocated, peak " << formatBytes(S.ParsePeak) << " live, AST "
+         << formatBytes(S.ASTBytes) << ", source buffers "
+         << formatBytes(S.SourceBytes) << "\n"
+         << "memory:   match   " << formatBytes(S.MatchAllocated)
+         << " allocated, peak " << formatBytes(S.MatchPeak) << " live\n"
+         << "memory:   replacements " << formatBytes(S.ReplacementBytes)
+         << "\n";
+    }
+    for (const auto &Rule : Rules) {
+      const RuleStats &S = Rule.second;
+      OS << "memory: rule " << Rule.first << ": " << S.Matches
+         << " matches, " << formatBytes(S.Allocated) << " allocated, peak "
+         << formatBytes(S.Peak) << " live, "
+         << formatBytes(S.ReplacementBytes) << " of replacements\n";
+    }
+
+    struct rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) == 0)
+      OS << "memory: peak RSS " << formatBytes(Usage.ru_maxrss * 1024ULL) << "\n";
+  }
+}
+
+#if defined(__GLIBC__)
+// Counting replacements for the global allocation functions. Every block
+// starts with a header holding the bytes that were counted for it, 0 if it
+// was allocated before enable(), so that delete subtracts exactly what new
+// added, whichever thread frees it.
+namespace {
+  const size_t HeaderSize = alignof(max_align_t);
+
+  void *countedAlloc(size_t Size) {
+    char *Block = static_cast<char *>(malloc(HeaderSize + Size));
+    if (!Block)
+      return nullptr;
+    size_t Counted = 0;
+    if (Memory::Enabled.load(std::memory_order_relaxed)) {
+      Counted = Size;
+      Memory::Thread.Allocated += Size;
+      ++Memory::Thread.Allocations;
+      int64_t Now = Memory::Live.fetch_add(Size, std::memory_order_relaxed) + Size;
+      if (Now > Memory::Thread.Peak)
+        Memory::Thread.Peak = Now;
+    }
+    *reinterpret_cast<size_t *>(Block) = Counted;
+    return Block + HeaderSize;
+  }
+
+  void countedFree(void *P) {
+    if (!P)
+      return;
+    char *Block = static_cast<char *>(P) - HeaderSize;
+    if (size_t Counted = *reinterpret_cast<size_t *>(Block))
+      Memory::Live.fetch_sub(Counted, std::memory_order_relaxed);
+    free(Block);
+  }
+}
+
+void *operator new(size_t Size) {
+  void *P = countedAlloc(Size);
+  if (!P)
+    throw std::bad_alloc();
+  return P;
+}
+
+void *operator new[](size_t Size) {
+  void *P = countedAlloc(Size);
+  if (!P)
+    throw std::bad_alloc();
+  return P;
+}
+
+void *operator new(size_t Size, const std::nothrow_t &) noexcept {
+  return countedAlloc(Size);
+}
+
+void *operator new[](size_t Size, const std::nothrow_t &) noexcept {
+  return countedAlloc(Size);
+}
+
+void operator delete(void *P) noexcept { countedFree(P); }
+void operator delete[](void *P) noexcept { countedFree(P); }
+void operator delete(void *P, const std::nothrow_t &) noexcept { countedFree(P); }
+void operator delete[](void *P, const std::nothrow_t &) noexcept { countedFree(P); }
+#endif
@@ -0,0 +1,89 @@
+//===- Memory.h - Heap accounting per phase, rule and TU ------------------===//
+//
+//  Counts the bytes allocated through operator new on each thread, so that
+//  parsing, matching and collecting replacements can be told apart. Live
+//  bytes are counted for the whole process, as blocks are freed on other
+//  threads than the ones that allocated them. Clang's own arenas (the
+//  ASTContext allocator and the SourceManager buffers) are not allocated
+//  through operator new and are reported separately from the statistics those
+//  classes keep.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_MEMORY_H
+#define QT4TO5_MEMORY_H
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace Memory {
+  // Starts counting. Nothing is counted until this is called.
+  void enable();
+  bool enabled();
+
+  // Heap use on the calling thread from construction until destruction.
+  // Phases nest: an inner phase does not hide the peak of the outer one.
+  class Phase {
+   public:
+    Phase();
+    ~Phase();
+
+    // Bytes allocated since the phase started.
+    uint64_t allocated() const;
+    // Number of allocations since the phase started.
+    uint64_t allocations() const;
+    // Highest number of live bytes in the process, as seen by allocations
+    // on this thread, above the level the phase started at.
+    uint64_t peak() const;
+
+   private:
+    uint64_t StartAllocated;
+    uint64_t StartAllocations;
+    int64_t StartLive;
+    int64_t OuterPeak;
+  };
+
+  struct TUStats {
+    TUStats()
+        : ParseAllocated(0), ParsePeak(0), ASTBytes(0), SourceBytes(0),
+          MatchAllocated(0), MatchPeak(0), ReplacementBytes(0) {}
+
+    uint64_t ParseAllocated;
+    uint64_t ParsePeak;
+    // ASTContext arena and side tables, and SourceManager buffers.
+    uint64_t ASTBytes;
+    uint64_t SourceBytes;
+    uint64_t MatchAllocated;
+    uint64_t MatchPeak;
+    uint64_t ReplacementBytes;
+  };
+
+  struct RuleStats {
+    RuleStats() : Matches(0), Allocated(0), Peak(0), ReplacementBytes(0) {}
+
+    uint64_t Matches;
+    uint64_t Allocated;
+    uint64_t Peak;
+    uint64_t ReplacementBytes;
+  };
+
+  void addTU(const std::string &File, const TUStats &Stats);
+  void addMatch(const std::string &Rule, uint64_t Allocated, uint64_t Peak);
+  // Bytes a rule added to the replacement storage: the staged entry and
+  // the text of its file name and replacement.
+  void addReplacement(const std::string &Rule, uint64_t Bytes);
+  // Replacement bytes added by this thread so far.
+  uint64_t threadReplacementBytes();
+
+  // Writes the per-TU and per-rule tables and the peak RSS.
+  void report(llvm::raw_ostream &OS);
+
+  // Formats a byte count as B, KB or MB.
+  std::string formatBytes(uint64_t Bytes);
+}
+
+#endif
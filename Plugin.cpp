@@ -0,0 +1,105 @@
+#include "Plugin.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/DynamicLibrary.h"
+
+#include "Qt4To5Plugin.h"
+#include "SourceHelpers.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace llvm;
+using clang::tooling::Replacement;
+
+namespace {
+// What a plugin sees of a PortRegistry. Kept apart from it so that the
+// registry can change without changing the plugin interface.
+class PluginRules : public Qt4To5Rules {
+ public:
+  PluginRules(PortRegistry &Ports, bool CreateIfdefs)
+      : Ports(Ports), CreateIfdefs(CreateIfdefs) {}
+
+  virtual MatchFinder &finder() { return Ports.finder(); }
+
+  virtual MatchFinder::MatchCallback *
+  addRule(const char *Id, const char *Name, MatchFinder::MatchCallback *Callback) {
+    return Ports.addRule(Id, Name, Callback);
+  }
+
+  virtual bool addReplacement(const SourceManager &SourceManager,
+                              const Replacement &Replacement) {
+    const FileEntry *Entry =
+        SourceManager.getFileManager().getFile(Replacement.getFilePath());
+    if (!Entry)
+      return false;
+    llvm::Error Result =
+        Utils::AddReplacement(Entry, Replacement, Ports.replacements());
+    if (!Result)
+      return true;
+    llvm::consumeError(std::move(Result));
+    return false;
+  }
+
+  virtual bool createIfdefs() const { return CreateIfdefs; }
+
+  virtual void addIfdef(SourceManager &SourceManager, SourceRange Range) {
+    RangeNode Node(Range);
+    insertIfdef(&SourceManager, &Node, Ports.replacements());
+  }
+
+ private:
+  // Gives a range the interface insertIfdef expects of a node.
+  struct RangeNode {
+    RangeNode(SourceRange Range) : Range(Range) {}
+    SourceLocation getLocStart() const { return Range.getBegin(); }
+    SourceLocation getLocEnd() const { return Range.getEnd(); }
+    SourceRange Range;
+  };
+
+  PortRegistry &Ports;
+  bool CreateIfdefs;
+};
+} // end namespace
+
+bool loadPlugin(StringRef Path, PortRegistry &Ports, bool CreateIfdefs,
+                raw_ostream &Errors) {
+  std::string Error;
+  sys::DynamicLibrary Library =
+      sys::DynamicLibrary::getPermanentLibrary(Path.str().c_str(), &Error);
+  if (!Library.isValid()) {
+    Errors << Path << ": " << Error << "\n";
+    return false;
+  }
+
+  typedef const Qt4To5PluginInfo *(*InfoFunction)();
+  InfoFunction GetInfo = reinterpret_cast<InfoFunction>(
+      Library.getAddressOfSymbol("qt4to5_plugin_info"));
+  if (!GetInfo) {
+    Errors << Path << ": not a qt4to5 plugin (no qt4to5_plugin_info)\n";
+    return false;
+  }
+
+  const Qt4To5PluginInfo *Info = GetInfo();
+  if (Info->APIVersion != QT4TO5_PLUGIN_API_VERSION) {
+    Errors << Path << ": built for plugin API version " << Info->APIVersion
+           << ", expected " << QT4TO5_PLUGIN_API_VERSION << "\n";
+    return false;
+  }
+  if (std::strcmp(Info->ClangVersion, CLANG_VERSION_STRING) != 0) {
+    Errors << Path << ": built against Clang " << Info->ClangVersion
+           << ", expected " << CLANG_VERSION_STRING << "\n";
+    return false;
+  }
+
+  // Callbacks may keep a reference to the rules they were registered with,
+  // so the adapter lives as long as the library does.
+  static std::vector<std::unique_ptr<PluginRules> > Adapters;
+  Adapters.push_back(std::unique_ptr<PluginRules>(new PluginRules(Ports, CreateIfdefs)));
+  Info->Register(*Adapters.back());
+  return true;
+}
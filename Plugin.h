@@ -0,0 +1,21 @@
+//===- Plugin.h - Loading rule plugins ------------------------------------===//
+//
+//  Loads the shared libraries given with -plugin and lets them add their
+//  rules to the PortRegistry of the run (see Qt4To5Plugin.h).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_PLUGIN_H
+#define QT4TO5_PLUGIN_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PortAction.h"
+
+// Loads the plugin in Path and registers its rules with Ports. Reports why
+// a plugin cannot be used to Errors and returns false.
+bool loadPlugin(llvm::StringRef Path, PortRegistry &Ports, bool CreateIfdefs,
+                llvm::raw_ostream &Errors);
+
+#endif
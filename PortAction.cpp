@@ -0,0 +1,176 @@
+#include "PortAction.h"
+
+#include <algorithm>
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
+
+#include "Diff.h"
+#include "Memory.h"
+#include "Probes.h"
+#include "Trace.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace llvm;
+
+namespace {
+// Time spent per matcher (keyed by RuleCallback::getID()) in the current TU.
+StringMap<TimeRecord> MatcherTimes;
+
+std::string formatBytes(uint64_t Bytes) {
+  return Memory::formatBytes(Bytes);
+}
+
+class PortConsumer : public ASTConsumer {
+ public:
+  PortConsumer(std::unique_ptr<ASTConsumer> Matcher, StringRef File)
+      : Matcher(std::move(Matcher)), File(File), ParseStart(0) {}
+
+  virtual void Initialize(ASTContext &Context) {
+    ParseStart = Trace::now();
+    ParsePhase.reset(new Memory::Phase);
+    Matcher->Initialize(Context);
+  }
+
+  // Called once parsing is done, so everything before it was parsing.
+  virtual void HandleTranslationUnit(ASTContext &Context) {
+    Memory::TUStats Stats;
+    if (ParsePhase) {
+      Stats.ParseAllocated = ParsePhase->allocated();
+      Stats.ParsePeak = ParsePhase->peak();
+      ParsePhase.reset();
+    }
+    Stats.ASTBytes = Context.getASTAllocatedMemory() +
+                     Context.getSideTableAllocatedMemory();
+    SourceManager::MemoryBufferSizes Buffers =
+        Context.getSourceManager().getMemoryBufferSizes();
+    Stats.SourceBytes = Buffers.malloc_bytes + Buffers.mmap_bytes +
+                        Context.getSourceManager().getDataStructureSizes();
+
+    Trace::Arguments ParseArgs;
+    if (Memory::enabled()) {
+      ParseArgs.push_back(std::make_pair("heap allocated", formatBytes(Stats.ParseAllocated)));
+      ParseArgs.push_back(std::make_pair("heap peak", formatBytes(Stats.ParsePeak)));
+      ParseArgs.push_back(std::make_pair("AST", formatBytes(Stats.ASTBytes)));
+      ParseArgs.push_back(std::make_pair("source buffers", formatBytes(Stats.SourceBytes)));
+    }
+    Trace::complete("Parse", File, ParseStart, ParseArgs);
+
+    uint64_t MatchStart = Trace::now();
+    uint64_t ReplacementStart = Memory::threadReplacementBytes();
+    {
+      Memory::Phase MatchPhase;
+      Matcher->HandleTranslationUnit(Context);
+      Stats.MatchAllocated = MatchPhase.allocated();
+      Stats.MatchPeak = MatchPhase.peak();
+    }
+    Stats.ReplacementBytes = Memory::threadReplacementBytes() - ReplacementStart;
+
+    Trace::Arguments Args;
+    for (const auto &Entry : MatcherTimes) {
+      Args.push_back(std::make_pair(
+          Entry.getKey().str(),
+          (Twine(format("%.3f", Entry.getValue().getWallTime() * 1000)) + " ms")
+              .str()));
+    }
+    MatcherTimes.clear();
+    if (Memory::enabled()) {
+      Args.push_back(std::make_pair("heap allocated", formatBytes(Stats.MatchAllocated)));
+      Args.push_back(std::make_pair("heap peak", formatBytes(Stats.MatchPeak)));
+      Args.push_back(std::make_pair("replacements", formatBytes(Stats.ReplacementBytes)));
+      Memory::addTU(File, Stats);
+    }
+    Trace::complete("Match", File, MatchStart, Args);
+    if (Diff::enabled())
+      Diff::finishTU(File, Context.getDiagnostics().hasErrorOccurred());
+  }
+
+ private:
+  std::unique_ptr<ASTConsumer> Matcher;
+  std::string File;
+  uint64_t ParseStart;
+  std::unique_ptr<Memory::Phase> ParsePhase;
+};
+
+class PortAction : public ASTFrontendAction {
+ public:
+  PortAction(MatchFinder &Finder) : Finder(Finder) {}
+
+ protected:
+  virtual std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                         StringRef File) {
+    return std::unique_ptr<ASTConsumer>(
+        new PortConsumer(Finder.newASTConsumer(), File));
+  }
+
+  virtual void ExecuteAction() {
+    const std::string File = getCurrentFile().str();
+    Trace::Scope Span("Source file", File);
+    Probes::currentFile() = File.c_str();
+    QT4TO5_PROBE1(tu__start, File.c_str());
+
+    ASTFrontendAction::ExecuteAction();
+
+    QT4TO5_PROBE1(tu__end, File.c_str());
+    Probes::currentFile() = "";
+  }
+
+ private:
+  MatchFinder &Finder;
+};
+} // end namespace
+
+MatchFinder::MatchFinderOptions finderOptions() {
+  MatchFinder::MatchFinderOptions Options;
+  if (Trace::enabled())
+    Options.CheckProfiling =
+        MatchFinder::MatchFinderOptions::Profiling(MatcherTimes);
+  return Options;
+}
+
+FrontendAction *PortActionFactory::create() {
+  return new PortAction(Finder);
+}
+
+void RuleCallback::run(const MatchFinder::MatchResult &Result) {
+  Trace::Scope Span(Name, Rule);
+  Probes::currentRule() = Rule.c_str();
+  QT4TO5_PROBE2(match__entry, Rule.c_str(), Probes::currentFile());
+
+  size_t Staged = Utils::StagedReplacements().size();
+  if (Memory::enabled()) {
+    Memory::Phase Phase;
+    Callback->run(Result);
+    Memory::addMatch(Rule, Phase.allocated(), Phase.peak());
+  } else {
+    Callback->run(Result);
+  }
+  // -results tells the replacements of a match that created an #if apart.
+  std::vector<Utils::StagedReplacement> &Made = Utils::StagedReplacements();
+  if (std::any_of(Made.begin() + Staged, Made.end(),
+                  [](const Utils::StagedReplacement &S) { return S.Ifdef; })) {
+    for (size_t I = Staged; I < Made.size(); ++I)
+      Made[I].Guarded = true;
+  }
+
+  QT4TO5_PROBE2(match__return, Rule.c_str(), Probes::currentFile());
+  Probes::currentRule() = "";
+}
+
+MatchFinder::MatchCallback *
+PortRegistry::addRule(const std::string &Rule, const std::string &Name,
+                      MatchFinder::MatchCallback *Callback) {
+  Callbacks.push_back(std::unique_ptr<MatchFinder::MatchCallback>(Callback));
+  Callbacks.push_back(std::unique_ptr<MatchFinder::MatchCallback>(
+      new RuleCallback(Callback, Rule, Name)));
+  if (std::find(Rules.begin(), Rules.end(), Rule) == Rules.end())
+    Rules.push_back(Rule);
+  return Callbacks.back().get();
+}
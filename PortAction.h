@@ -0,0 +1,84 @@
+//===- PortAction.h - Frontend action running the porting matchers --------===//
+//
+//  Runs a MatchFinder over each translation unit. Every rule's callback is
+//  wrapped in a RuleCallback so that per-rule instrumentation lives in one
+//  place instead of in each callback.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_PORTACTION_H
+#define QT4TO5_PORTACTION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/Tooling.h"
+
+// Options for the MatchFinder of a porting run. With tracing enabled, the
+// time spent in each matcher is recorded and attached to the "Match" span.
+clang::ast_matchers::MatchFinder::MatchFinderOptions finderOptions();
+
+// Creates the actions that run Finder over each TU.
+class PortActionFactory : public clang::tooling::FrontendActionFactory {
+ public:
+  PortActionFactory(clang::ast_matchers::MatchFinder &Finder)
+      : Finder(Finder) {}
+
+  virtual clang::FrontendAction *create();
+
+ private:
+  clang::ast_matchers::MatchFinder &Finder;
+};
+
+// Forwards matches to the callback of a rule.
+class RuleCallback : public clang::ast_matchers::MatchFinder::MatchCallback {
+ public:
+  // Rule is the command line name of the rule, Name the name of the
+  // callback as shown in traces.
+  RuleCallback(clang::ast_matchers::MatchFinder::MatchCallback *Callback,
+               const std::string &Rule, const std::string &Name)
+      : Callback(Callback), Rule(Rule), Name(Name + "::run") {}
+
+  virtual void run(const clang::ast_matchers::MatchFinder::MatchResult &Result);
+  virtual void onStartOfTranslationUnit() { Callback->onStartOfTranslationUnit(); }
+  virtual void onEndOfTranslationUnit() { Callback->onEndOfTranslationUnit(); }
+  virtual llvm::StringRef getID() const { return Rule; }
+
+ private:
+  clang::ast_matchers::MatchFinder::MatchCallback *Callback;
+  std::string Rule;
+  std::string Name;
+};
+
+// The rules of one run. Every selected rule adds its matchers to the same
+// MatchFinder, so that all of them share a single parse of each TU, and
+// writes its replacements to the same map.
+class PortRegistry {
+ public:
+  PortRegistry(std::map<std::string, clang::tooling::Replacements> *Replace)
+      : Finder(finderOptions()), Replace(Replace) {}
+
+  clang::ast_matchers::MatchFinder &finder() { return Finder; }
+  std::map<std::string, clang::tooling::Replacements> *replacements() { return Replace; }
+
+  // Takes ownership of Callback and returns the callback to register the
+  // matchers of Rule with.
+  clang::ast_matchers::MatchFinder::MatchCallback *
+  addRule(const std::string &Rule, const std::string &Name,
+          clang::ast_matchers::MatchFinder::MatchCallback *Callback);
+
+  // The ids of all rules added so far, in order.
+  const std::vector<std::string> &rules() const { return Rules; }
+
+ private:
+  clang::ast_matchers::MatchFinder Finder;
+  std::map<std::string, clang::tooling::Replacements> *Replace;
+  std::vector<std::unique_ptr<clang::ast_matchers::MatchFinder::MatchCallback> > Callbacks;
+  std::vector<std::string> Rules;
+};
+
+#endif
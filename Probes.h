@@ -0,0 +1,45 @@
+//===- Probes.h - USDT probes on the porting hot paths --------------------===//
+//
+//  Static tracepoints for perf, bpftrace or SystemTap, e.g.
+//
+//    bpftrace -e 'usdt:./qt4to5:qt4to5:match__entry { @[str(arg0)] = count(); }'
+//
+//  Probes compile to a single nop when <sys/sdt.h> is available and to
+//  nothing otherwise. All string arguments are NUL-terminated.
+//
+//    tu__start(file), tu__end(file)
+//    match__entry(rule, file), match__return(rule, file)
+//    replacement__add(rule, file, offset, length)
+//    file__write(rule, file)
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_PROBES_H
+#define QT4TO5_PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define QT4TO5_PROBE1(name, a) DTRACE_PROBE1(qt4to5, name, a)
+#define QT4TO5_PROBE2(name, a, b) DTRACE_PROBE2(qt4to5, name, a, b)
+#define QT4TO5_PROBE4(name, a, b, c, d) DTRACE_PROBE4(qt4to5, name, a, b, c, d)
+#else
+#define QT4TO5_PROBE1(name, a) do {} while (0)
+#define QT4TO5_PROBE2(name, a, b) do {} while (0)
+#define QT4TO5_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+namespace Probes {
+  // The rule whose callback is running on this thread, or "".
+  inline const char *&currentRule() {
+    static thread_local const char *Rule = "";
+    return Rule;
+  }
+
+  // The main file of the TU being processed on this thread, or "".
+  inline const char *&currentFile() {
+    static thread_local const char *File = "";
+    return File;
+  }
+}
+
+#endif
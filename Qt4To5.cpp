@@ -37,20 +37,42 @@
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Lex/Lexer.h"
+#include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <system_error>
 
+#include <algorithm>
 #include <iostream>
-
+#include <mutex>
+#include <set>
+
+#include "Diff.h"
+#include "Fixes.h"
+#include "IncludeGraph.h"
+#include "Memory.h"
+#include "Plugin.h"
+#include "PortAction.h"
+#include "Probes.h"
+#include "Results.h"
+#include "RuleFile.h"
+#include "Shard.h"
+#include "SourceHelpers.h"
+#include "Trace.h"
+#include "Unity.h"
 #include "Utils.h"
+#include "Verify.h"
+#include "Watchdog.h"
 
 using std::error_code;
 using namespace clang;
@@ -122,104 +144,321 @@ cl::opt<bool> Port_QAbstractItemView_dataChanged(
   cl::desc("Port uses of QAbstractItemView::dataChanged")
 );
 
+cl::opt<bool> PortQStringArg(
+  "port-qstring-arg",
+  cl::desc("Collapse chains of QString::arg calls into one multi-argument call")
+);
+
+cl::opt<bool> PortQStringRef(
+  "port-qstringref",
+  cl::desc("Use midRef, leftRef, rightRef and splitRef where the substrings are only read")
+);
+
+cl::opt<bool> PortReserve(
+  "port-reserve",
+  cl::desc("Reserve room in containers that are filled by a counted loop right after their declaration")
+);
+
+cl::opt<bool> PortQHash(
+  "port-qhash",
+  cl::desc("Use QHash for QMap variables and private members whose order is never used")
+);
+
+cl::opt<bool> PortSequences(
+  "port-sequences",
+  cl::desc("Replace QLinkedList, and QList used as a queue, by the container their accesses suit")
+);
+
+cl::opt<bool> PortQObjectCast(
+  "port-qobject-cast",
+  cl::desc("Use qobject_cast for dynamic_cast between QObject classes and report other RTTI uses")
+);
+
+cl::opt<bool> PortElapsedTimer(
+  "port-elapsed-timer",
+  cl::desc("Time with QElapsedTimer and QDateTime::currentMSecsSinceEpoch() instead of QTime and QDateTime")
+);
+
+cl::opt<bool> PortSignalMappers(
+  "port-signal-mapper",
+  cl::desc("Connect to lambdas instead of local QSignalMappers and report slots that use sender()")
+);
+
+cl::opt<bool> PortMakeShared(
+  "port-make-shared",
+  cl::desc("Allocate objects owned by QSharedPointer or std::shared_ptr together with their reference count")
+);
+
+cl::opt<bool> PortMetaTypes(
+  "port-metatypes",
+  cl::desc("Look up meta types by type instead of name, register them once and use Q_ENUM for Q_ENUMS")
+);
+
+cl::list<std::string> RuleFiles(
+  "rules",
+  cl::desc("Also run the rules declared in <file> (see RuleFile.h for the format)"),
+  cl::value_desc("file")
+);
+
+cl::list<std::string> Plugins(
+  "plugin",
+  cl::desc("Load the rules of the qt4to5 plugin <file> (see Qt4To5Plugin.h)"),
+  cl::value_desc("file")
+);
+
+cl::opt<bool> VerifyRewrites(
+  "verify",
+  cl::desc("Syntax-check every TU affected by the rewrite against Qt 5")
+);
+
+cl::list<std::string> VerifyQt5Includes(
+  "verify-qt5-include",
+  cl::desc("Qt 5 include directory used by -verify"),
+  cl::value_desc("dir")
+);
+
+cl::list<std::string> VerifyQt4Includes(
+  "verify-qt4-include",
+  cl::desc("Qt 4 include directory used by -verify when -create-ifdefs is set"),
+  cl::value_desc("dir")
+);
+
+cl::opt<bool> RebuildImpact(
+  "rebuild-impact",
+  cl::desc("Report how many TUs and preprocessed lines the rewrite forces to recompile")
+);
+
+cl::opt<std::string> TraceFile(
+  "trace",
+  cl::desc("Write a Chrome trace-event timeline of the run to <file>"),
+  cl::value_desc("file")
+);
+
+cl::opt<bool> MemoryStats(
+  "memory-stats",
+  cl::desc("Report heap use per phase, TU and rule")
+);
+
+cl::opt<std::string> ResultsFile(
+  "results",
+  cl::desc("Write every replacement to <file> (\"-\" for stdout) as the TUs finish"),
+  cl::value_desc("file")
+);
+
+cl::opt<Results::Format> ResultsFormat(
+  "results-format",
+  cl::desc("Format of -results"),
+  cl::values(
+    clEnumValN(Results::JSONLines, "json", "JSON Lines, one object per replacement (default)"),
+    clEnumValN(Results::SARIF, "sarif", "SARIF 2.1.0")),
+  cl::init(Results::JSONLines)
+);
+
+cl::opt<std::string> DiffFile(
+  "diff",
+  cl::ValueOptional,
+  cl::desc("Write a unified diff to <file> (stdout if none is given) instead of rewriting the sources"),
+  cl::value_desc("file")
+);
+
+cl::opt<unsigned> Jobs(
+  "j",
+  cl::desc("Number of parallel jobs (defaults to the number of cores)"),
+  cl::init(0)
+);
+
+cl::opt<std::string> Shard(
+  "shard",
+  cl::desc("Port only shard i (counting from 0) of N and write its fixes to -shard-dir"),
+  cl::value_desc("i/N")
+);
+
+cl::opt<std::string> ShardDir(
+  "shard-dir",
+  cl::desc("Shared directory for the fixes of -shard and -merge-shards"),
+  cl::value_desc("dir")
+);
+
+cl::opt<bool> MergeShards(
+  "merge-shards",
+  cl::desc("Merge the fixes of all shards in -shard-dir and apply them")
+);
+
+cl::opt<unsigned> TUTimeout(
+  "tu-timeout",
+  cl::desc("Port each TU in a worker process and kill it after <seconds>"),
+  cl::value_desc("seconds"),
+  cl::init(0)
+);
+
+cl::opt<unsigned> TUMemoryLimit(
+  "tu-memory-limit",
+  cl::desc("Port each TU in a worker process limited to <MB> of memory"),
+  cl::value_desc("MB"),
+  cl::init(0)
+);
+
+cl::opt<std::string> WorkerFixes(
+  "worker-fixes",
+  cl::desc("Write the fixes to <file> instead of applying them (used by worker processes)"),
+  cl::value_desc("file"),
+  cl::Hidden
+);
+
+cl::opt<bool> ReducedParse(
+  "reduced-parse",
+  cl::desc("Parse with lower template and constexpr limits and stop at the first error"),
+  cl::Hidden
+);
+
+cl::opt<bool> Unity(
+  "unity",
+  cl::desc("Parse small TUs with the same compile command together in unity batches")
+);
+
+cl::opt<unsigned> UnityMaxLines(
+  "unity-max-lines",
+  cl::desc("Largest TU, in lines, that -unity batches"),
+  cl::value_desc("lines"),
+  cl::init(200)
+);
+
 cl::list<std::string> SourcePaths(
   cl::Positional,
   cl::desc("<source0> [... <sourceN>]"),
-  cl::OneOrMore);
-
-// FIXME: Pull out helper methods in here into more fitting places.
-
-// Returns the text that makes up 'node' in the source.
-// Returns an empty string if the text cannot be found.
-template <typename T>
-static std::string getText(const SourceManager &SourceManager, const T &Node) {
-  SourceLocation StartSpellingLocation =
-      SourceManager.getSpellingLoc(Node.getLocStart());
-  SourceLocation EndSpellingLocation =
-      SourceManager.getSpellingLoc(Node.getLocEnd());
-  if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
-    return std::string();
-  }
-  bool Invalid = true;
-  const char *Text =
-      SourceManager.getCharacterData(StartSpellingLocation, &Invalid);
-  if (Invalid) {
-    return std::string();
-  }
-  std::pair<FileID, unsigned> Start =
-      SourceManager.getDecomposedLoc(StartSpellingLocation);
-  std::pair<FileID, unsigned> End =
-      SourceManager.getDecomposedLoc(Lexer::getLocForEndOfToken(
-          EndSpellingLocation, 0, SourceManager, LangOptions()));
-  if (Start.first != End.first) {
-    // Start and end are in different files.
-    std::cout << "Start and end are in different files. " << Start.first.getHashValue() << " -- "<< End.first.getHashValue() << std::endl;
-    return std::string();
-  }
-  if (End.second < Start.second) {
-    // Shuffling text with macros may cause this.
-    std::cout << "Shuffling text with macros may cause this." << Start.second << " -- "<< End.second << std::endl;
-    return std::string();
-  }
-  return std::string(Text, End.second - Start.second);
+  cl::ZeroOrMore);
+
+static unsigned jobCount() {
+  return Jobs ? Jobs : llvm::thread::hardware_concurrency();
 }
 
-template <typename T>
-void insertIfdef(clang::SourceManager * const SourceManager, const T *Node, std::map<std::string, Replacements> *Replace)
+static unsigned ShardIndex = 0;
+static unsigned ShardCount = 0;
+static WorkerOptions Workers;
+
+// The files to port: all of them, or this shard's share with -shard.
+static std::vector<std::string> sourceFiles() {
+  std::vector<std::string> Files(SourcePaths.begin(), SourcePaths.end());
+  if (ShardCount == 0)
+    return Files;
+  return filesForShard(Files, ShardIndex, ShardCount);
+}
+
+// Same as RefactoringTool::runAndSave() after the run, split up so that
+// merging and writing show up separately in traces.
+static int saveReplacements(FileManager &Files, const std::map<std::string, Replacements> &Replace,
+                            const std::string &Rule)
 {
-  SourceLocation StartSpellingLocation =
-      SourceManager->getSpellingLoc(Node->getLocStart());
-  SourceLocation EndSpellingLocation =
-      SourceManager->getSpellingLoc(Node->getLocEnd());
-  if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
-    return;
+  LangOptions DefaultLangOptions;
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
+  TextDiagnosticPrinter DiagnosticPrinter(llvm::errs(), &*DiagOpts);
+  DiagnosticsEngine Diagnostics(
+      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+      &*DiagOpts, &DiagnosticPrinter, false);
+  SourceManager Sources(Diagnostics, Files);
+  Rewriter Rewrite(Sources, DefaultLangOptions);
+
+  {
+    Trace::Scope Span("Merge replacements");
+    if (!tooling::applyAllReplacements(Replace, Rewrite))
+      llvm::errs() << "Skipped some replacements.\n";
   }
 
-  FullSourceLoc fs(StartSpellingLocation, *SourceManager);
+  Trace::Scope Span("Write files");
+  for (Rewriter::buffer_iterator I = Rewrite.buffer_begin(), E = Rewrite.buffer_end(); I != E; ++I) {
+    const FileEntry *Entry = Sources.getFileEntryForID(I->first);
+    if (!Entry)
+      continue;
+    // getName() returns a const char * before Clang 5 and a StringRef after.
+    std::string Name = Entry->getName();
+    QT4TO5_PROBE2(file__write, Rule.c_str(), Name.c_str());
+  }
+  return Rewrite.overwriteChangedFiles() ? 1 : 0;
+}
 
-  bool Invalid = true;
-  SourceLocation StartOfLine = StartSpellingLocation.getLocWithOffset(-fs.getSpellingColumnNumber(&Invalid) + 1);
-  if (Invalid) {
-    return;
+// Runs the rules in Ports over all sources and writes the replacements back to disk.
+// Afterwards the include graph is built if -verify or -rebuild-impact need
+// to know which TUs include the rewritten files.
+static int runPort(tooling::RefactoringTool &Tool, PortRegistry &Ports,
+                   const CompilationDatabase &Compilations)
+{
+  std::string Rule;
+  for (const std::string &Id : Ports.rules())
+    Rule += (Rule.empty() ? "" : ",") + Id;
+
+  int Result = 0;
+  // With workers, a TU that has no result still leaves the others' to save.
+  bool Incomplete = false;
+  // What was merged, with the rules that made it.
+  std::vector<Utils::RankedReplacement> Accepted;
+  if (TUTimeout || TUMemoryLimit) {
+    Incomplete = !runWorkers(sourceFiles(), Workers, Tool.getReplacements(), Accepted, llvm::errs());
+  } else {
+    tooling::ArgumentsAdjuster Adjuster;
+    if (ReducedParse)
+      Adjuster = tooling::getInsertArgumentAdjuster(
+          tooling::CommandLineArguments{"-ftemplate-depth=64", "-fconstexpr-depth=64",
+                                        "-fconstexpr-steps=65536", "-ferror-limit=1", "-w"},
+          tooling::ArgumentInsertPosition::END);
+    PortActionFactory Factory(Ports.finder());
+    if (Unity) {
+      UnityOptions Options;
+      Options.MaxLines = UnityMaxLines;
+      Options.Adjuster = Adjuster;
+      Result = runUnity(Compilations, sourceFiles(), Options, Factory, llvm::errs());
+    } else {
+      if (Adjuster)
+        Tool.appendArgumentsAdjuster(Adjuster);
+      Result = Tool.run(&Factory);
+    }
+    // Rules registered first win conflicts, whatever order TUs ran in.
+    Utils::MergeStaged(Ports.rules(), llvm::errs(), &Accepted);
   }
 
-  const char *Text =
-      SourceManager->getCharacterData(StartOfLine, &Invalid);
-  std::pair<FileID, unsigned> Start =
-      SourceManager->getDecomposedLoc(StartOfLine);
-  std::pair<FileID, unsigned> End =
-      SourceManager->getDecomposedLoc(Lexer::getLocForEndOfToken(
-          EndSpellingLocation, 0, *SourceManager, LangOptions()));
-  if (Start.first != End.first) {
-    std::cout << "Start and end are in different files. " << Start.first.getHashValue() << " -- "<< End.first.getHashValue() << std::endl;
-    return;
+  // A worker hands whatever it found to the parent, which decides what to keep.
+  if (!WorkerFixes.empty())
+    return writeFixes(WorkerFixes, SourcePaths.front(), Accepted, Result == 0, llvm::errs()) ? Result : 1;
+  // Files the TUs finished with are diffed already; the rest, and whatever
+  // the workers found, is diffed now.
+  if (Diff::enabled()) {
+    Diff::addReplacements(Accepted);
+    return Diff::close() && !Incomplete ? Result : 1;
   }
-  if (End.second < Start.second) {
-    std::cout << "Shuffling text with macros may cause this." << Start.second << " -- "<< End.second << std::endl;
-    return;
+  // A shard exports what it found even if some TUs failed, so that one bad
+  // TU does not discard the others' work; the merge reports it.
+  if (ShardCount) {
+    bool Complete = Result == 0 && !Incomplete;
+    return exportShard(ShardDir, ShardIndex, ShardCount, Accepted, Complete, llvm::errs()) &&
+           Complete ? 0 : 1;
   }
-
-  unsigned eol = End.second - Start.second;
-  while (Text[eol] != '\n') {
-    ++eol;
+  if (Result == 0) {
+    // Read from the sources, so before they are rewritten.
+    Results::addReplacements(Accepted);
+    Result = saveReplacements(Tool.getFiles(), Tool.getReplacements(), Rule);
   }
+  if (Result != 0 || !(VerifyRewrites || RebuildImpact))
+    return Incomplete ? 1 : Result;
 
-  std::string ExistingText = std::string(Text, eol);
+  RewrittenFiles Rewritten;
+  addRewrittenFiles(Tool.getReplacements(), Rule, Rewritten);
+  if (Rewritten.empty())
+    return Incomplete ? 1 : 0;
 
-  SourceLocation EndOfLine = StartOfLine.getLocWithOffset(eol);
-  
-  Utils::AddReplacement(
-      SourceManager->getFileEntryForID(Start.first),
-      Replacement(*SourceManager, StartOfLine, 0, "#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)\n" + ExistingText + "\n#else\n"),
-      Replace
-    );
-  //Replace->add(Replacement(*SourceManager, StartOfLine, 0, "#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)\n" + ExistingText + "\n#else\n"));
-  Utils::AddReplacement(
-      SourceManager->getFileEntryForID(Start.first),
-      Replacement(*SourceManager, EndOfLine, 0, "\n#endif"),
-      Replace
-  );
-  //Replace->add(Replacement(*SourceManager, EndOfLine, 0, "\n#endif"));
+  IncludeGraph Graph(Compilations, jobCount());
+
+  if (RebuildImpact)
+    reportRebuildImpact(Graph, Rewritten, llvm::errs());
+
+  if (!VerifyRewrites)
+    return Incomplete ? 1 : 0;
+
+  VerifyOptions Options;
+  Options.Qt5IncludePaths = VerifyQt5Includes;
+  Options.Qt4IncludePaths = VerifyQt4Includes;
+  Options.CheckQt4 = CreateIfdefs;
+  Options.Jobs = jobCount();
+
+  return verifyRewrittenFiles(Compilations, Graph, Rewritten, Options, llvm::errs()) && !Incomplete ? 0 : 1;
 }
 
 #define QStringClassName "QString"
@@ -482,44 +721,14 @@ class RemoveArgument : public ast_matchers::MatchFinder::MatchCallback {
     const Expr *Lang =
         Result.Nodes.getNodeAs<Expr>("arg");
 
-    SourceLocation StartSpellingLocation =
-        Result.SourceManager->getSpellingLoc(Key->getLocEnd());
-
-    SourceLocation EndSpellingLocation =
-        Result.SourceManager->getSpellingLoc(Lang->getLocEnd());
-    if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
-      return;
-    }
-    std::pair<FileID, unsigned> Start =
-        Result.SourceManager->getDecomposedLoc(Lexer::getLocForEndOfToken(
-            StartSpellingLocation, 0, *Result.SourceManager, LangOptions()));
-    std::pair<FileID, unsigned> End =
-        Result.SourceManager->getDecomposedLoc(Lexer::getLocForEndOfToken(
-            EndSpellingLocation, 0, *Result.SourceManager, LangOptions()));
-    if (Start.first != End.first) {
-      // Start and end are in different files.
-      std::cout << "Start and end are in different files. " << Start.first.getHashValue() << " -- "<< End.first.getHashValue() << std::endl;
-      return;
-    }
-    if (End.second < Start.second) {
-      // Shuffling text with macros may cause this.
-      std::cout << "Shuffling text with macros may cause this." << Start.second << " -- "<< End.second << std::endl;
+    CharSourceRange range;
+    FileID File;
+    if (!getArgumentRemovalRange(*Result.SourceManager, *Key, *Lang, range, File))
       return;
-    }
 
-    // Key->getLocEnd() doesn't get the end of the token, but the start.
-    // Use this hack to get the real ends.
-    SourceLocation StartOfFile = StartSpellingLocation.getLocWithOffset(-Result.SourceManager->getFileOffset(Key->getLocStart()));
-    StartSpellingLocation = StartOfFile.getLocWithOffset(Start.second);
-    EndSpellingLocation = StartOfFile.getLocWithOffset(End.second);
-
-    CharSourceRange range;
-    range.setBegin(StartSpellingLocation);
-    range.setEnd(EndSpellingLocation);
-    
     SourceManager &srcMgr = Result.Context->getSourceManager();
     Utils::AddReplacement(
-      srcMgr.getFileEntryForID(Start.first),
+      srcMgr.getFileEntryForID(File),
       Replacement(*Result.SourceManager, range, ""),
       Replace
     );
@@ -532,220 +741,2614 @@ class RemoveArgument : public ast_matchers::MatchFinder::MatchCallback {
  private:
   std::map<std::string, Replacements> *Replace;
 };
-} // end namespace
 
-int portMethod(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
-
-  ast_matchers::MatchFinder Finder;
-
-  std::string matchName = RenameMethod_Class.size() ? RenameMethod_Class : std::string();
-  matchName += "::" + Rename_Old;
-
-  PortRenamedMethods RenameMethodCallback(&Tool.getReplacements());
-
-  Finder.addMatcher(
-      callExpr(
-        anyOf(
-          allOf(
-            callee(functionDecl(hasName(matchName))),
-            callee(memberExpr().bind("exact"))
-          ),
-          allOf(
-            callee(functionDecl(hasName(Rename_Old))),
-            callee(memberExpr().bind("expr"))
-          ),
-          allOf(
-            callee(functionDecl(hasName(matchName))),
-            callee(expr().bind("func"))
-          )
-        )
-      ).bind("call"), 
-      &RenameMethodCallback);
+// Returns the node that uses the value of E, looking through implicit
+// conversions and temporaries. Child is set to the node below it.
+const Stmt *user(ASTContext &Context, const Expr *E, const Stmt *&Child) {
+  Child = E;
+  for (;;) {
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*Child);
+    if (Parents.size() != 1)
+      return nullptr;
+    const Stmt *Parent = Parents[0].get<Stmt>();
+    if (!Parent || !(isa<ImplicitCastExpr>(Parent) || isa<MaterializeTemporaryExpr>(Parent) ||
+                     isa<CXXBindTemporaryExpr>(Parent)))
+      return Parent;
+    Child = Parent;
+  }
+}
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
+// Returns the call of the method Member names.
+const CXXMemberCallExpr *memberCall(ASTContext &Context, const MemberExpr *Member) {
+  ASTContext::DynTypedNodeList Parents = Context.getParents(*Member);
+  return Parents.size() == 1 ? Parents[0].get<CXXMemberCallExpr>() : nullptr;
 }
 
-int portQMetaMethodSignature(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+// Appends every reference to Decl in S to Uses.
+void references(const Stmt *S, const ValueDecl *Decl,
+                std::vector<const DeclRefExpr *> &Uses) {
+  if (!S)
+    return;
+  if (const DeclRefExpr *Ref = dyn_cast<DeclRefExpr>(S)) {
+    if (Ref->getDecl() == Decl)
+      Uses.push_back(Ref);
+  }
+  for (const Stmt *Child : S->children())
+    references(Child, Decl, Uses);
+}
 
-  ast_matchers::MatchFinder Finder;
+// Sets Indent to the white space before Loc on its line. Returns false if
+// Loc is not the first thing on the line.
+bool indentation(const SourceManager &SourceManager, SourceLocation Loc, std::string &Indent) {
+  bool Invalid = false;
+  unsigned Column = SourceManager.getSpellingColumnNumber(Loc, &Invalid);
+  if (Invalid)
+    return false;
+  StringRef Text(SourceManager.getCharacterData(Loc) - (Column - 1), Column - 1);
+  if (Text.find_first_not_of(" \t") != StringRef::npos)
+    return false;
+  Indent = Text.str();
+  return true;
+}
 
-  PortMetaMethods MetaMethodCallback(&Tool.getReplacements());
+// Returns the statement of block Block that E is all of.
+const Stmt *blockStatement(ASTContext &Context, const Expr *E, const CompoundStmt *&Block) {
+  const Stmt *S = E;
+  for (;;) {
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*S);
+    if (Parents.size() != 1)
+      return nullptr;
+    if ((Block = Parents[0].get<CompoundStmt>()))
+      return S;
+    const Stmt *Parent = Parents[0].get<Stmt>();
+    if (!Parent || !(isa<ExprWithCleanups>(Parent) || isa<CXXBindTemporaryExpr>(Parent) ||
+                     isa<ImplicitCastExpr>(Parent) || isa<MaterializeTemporaryExpr>(Parent)))
+      return nullptr;
+    S = Parent;
+  }
+}
 
-  Finder.addMatcher(
-    	stmt(
-      	stmt(
-          has(
-            callExpr(
-              callee(
-                memberExpr()
-              )
-            ).bind("call")
-          ),
-          has(callExpr(callee(functionDecl(hasName("::QMetaMethod::signature")))))
-        ),
-        expr(unless(clang::ast_matchers::binaryOperator()))
-      )
-    , &MetaMethodCallback);
+// Returns the range that removes the text from Begin to End, together with
+// its line if nothing else is on it.
+CharSourceRange removalRange(const SourceManager &SourceManager, SourceLocation Begin,
+                             SourceLocation End) {
+  FileID File = SourceManager.getFileID(Begin);
+  StringRef Buffer = SourceManager.getBufferData(File);
+  unsigned First = SourceManager.getFileOffset(Begin);
+  unsigned After = SourceManager.getFileOffset(End);
+  while (First > 0 && (Buffer[First - 1] == ' ' || Buffer[First - 1] == '\t'))
+    --First;
+  while (After < Buffer.size() && (Buffer[After] == ' ' || Buffer[After] == '\t'))
+    ++After;
+  if ((First == 0 || Buffer[First - 1] == '\n') && After < Buffer.size() && Buffer[After] == '\n') {
+    SourceLocation Start = SourceManager.getLocForStartOfFile(File);
+    return CharSourceRange::getCharRange(Start.getLocWithOffset(First), Start.getLocWithOffset(After + 1));
+  }
+  return CharSourceRange::getCharRange(Begin, End);
+}
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
+// Returns true if Format is a string literal without %L markers, or a
+// QString or QLatin1String made from one, i.e. if it cannot format numbers
+// in the current locale. The text of any call, such as tr() or
+// translate(), is only known at run time, and a translation may use %L.
+bool plainFormat(const Expr *Format) {
+  for (;;) {
+    Format = Format->IgnoreImplicit()->IgnoreParens();
+    if (const StringLiteral *Literal = dyn_cast<StringLiteral>(Format))
+      return !Literal->getBytes().contains("%L");
+    if (const CXXFunctionalCastExpr *Cast = dyn_cast<CXXFunctionalCastExpr>(Format)) {
+      Format = Cast->getSubExpr();
+      continue;
+    }
+    const CXXConstructExpr *Construct = dyn_cast<CXXConstructExpr>(Format);
+    if (!Construct || Construct->getNumArgs() != 1)
+      return false;
+    std::string Class = Construct->getConstructor()->getParent()->getQualifiedNameAsString();
+    if (Class != QStringClassName && Class != QLatin1StringClassName)
+      return false;
+    Format = Construct->getArg(0);
+  }
 }
 
-int portQtEscape(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+class CollapseArgChain : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  CollapseArgChain(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
 
-  ast_matchers::MatchFinder Finder;
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    const CXXMemberCallExpr *Call =
+        Result.Nodes.getNodeAs<CXXMemberCallExpr>("call");
+
+    // Numbers can only become QString::number() if the format cannot
+    // contain %L markers.
+    const Expr *Format = Call;
+    while (const CXXMemberCallExpr *Link = argCall(Format))
+      Format = Link->getImplicitObjectArgument();
+    bool Numbers = plainFormat(Format);
+
+    // The whole chain is handled where it ends.
+    if (const CXXMemberCallExpr *Next = nextCall(*Result.Context, Call)) {
+      if (!argument(*Result.SourceManager, Next, Numbers).empty())
+        return;
+    }
 
-  PortQtEscape4To5 Callback(&Tool.getReplacements());
+    std::vector<std::string> Args;
+    const CXXMemberCallExpr *Innermost = nullptr;
+    for (const CXXMemberCallExpr *Link = Call; Link; Link = argCall(Link->getImplicitObjectArgument())) {
+      std::string Arg = argument(*Result.SourceManager, Link, Numbers);
+      if (Arg.empty())
+        break;
+      Args.push_back(Arg);
+      Innermost = Link;
+    }
+    if (Args.size() < 2 || Call->getLocEnd().isMacroID() ||
+        Innermost->getImplicitObjectArgument()->getLocEnd().isMacroID())
+      return;
+    std::reverse(Args.begin(), Args.end());
+
+    // The multi-argument overloads take up to nine arguments.
+    const MemberExpr *Callee = cast<MemberExpr>(Innermost->getCallee());
+    std::string Text;
+    for (size_t I = 0; I < Args.size(); I += 9) {
+      Text += I == 0 && Callee->isArrow() ? "->arg(" : ".arg(";
+      for (size_t J = I; J < std::min(I + 9, Args.size()); ++J)
+        Text += (J > I ? ", " : "") + Args[J];
+      Text += ")";
+    }
 
-  Finder.addMatcher(
-    callExpr(
-      callee(functionDecl(hasName(QtEscapeFunction))),
-      hasArgument(
-        0,
-        anyOf(
-          cxxBindTemporaryExpr(has(cxxOperatorCallExpr().bind("operator"))),//unclear wheather or not this is needed still
-          cxxOperatorCallExpr().bind("operator"),
-          cxxConstructExpr().bind("ctor"),
-          expr().bind("expr")
-        )
-      )
-    ).bind("call"),
-    &Callback);
+    SourceManager &srcMgr = Result.Context->getSourceManager();
+    SourceLocation Begin = Lexer::getLocForEndOfToken(
+        Innermost->getImplicitObjectArgument()->getLocEnd(), 0, srcMgr, Result.Context->getLangOpts());
+    SourceLocation End = Lexer::getLocForEndOfToken(
+        Call->getLocEnd(), 0, srcMgr, Result.Context->getLangOpts());
+    if (Begin.isInvalid() || End.isInvalid() ||
+        srcMgr.getFileID(Begin) != srcMgr.getFileID(End))
+      return;
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
-}
+    // The multi-argument overloads exist in Qt 4 as well, so no #if is needed.
+    Utils::AddReplacement(
+      srcMgr.getFileEntryForID(srcMgr.getFileID(Begin)),
+      Replacement(srcMgr, CharSourceRange::getCharRange(Begin, End), Text),
+      Replace
+    );
+  }
 
-int portAtomics(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+ private:
+  // Returns E as a call of QString::arg, if it is one.
+  static const CXXMemberCallExpr *argCall(const Expr *E) {
+    const CXXMemberCallExpr *Call = dyn_cast<CXXMemberCallExpr>(E->IgnoreImplicit());
+    const CXXMethodDecl *Method = Call ? Call->getMethodDecl() : nullptr;
+    if (!Method || Method->getQualifiedNameAsString() != QStringClassName "::arg")
+      return nullptr;
+    return Call;
+  }
 
-  ast_matchers::MatchFinder Finder;
+  // Returns the QString::arg call that Call is the object of, if any.
+  static const CXXMemberCallExpr *nextCall(ASTContext &Context, const Expr *Call) {
+    const Stmt *Child;
+    const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(user(Context, Call, Child));
+    const CXXMemberCallExpr *Next = Member ? memberCall(Context, Member) : nullptr;
+    return Next && argCall(Next) ? Next : nullptr;
+  }
 
-  PortAtomic AtomicCallback(&Tool.getReplacements());
+  // Returns the text Call's argument takes in the multi-argument overload,
+  // or an empty string if Call passes a field width, base, format or fill
+  // character or its argument cannot be converted to a QString unchanged.
+  static std::string argument(const SourceManager &SourceManager,
+                              const CXXMemberCallExpr *Call, bool Numbers) {
+    if (!argCall(Call) || Call->getNumArgs() < 1)
+      return std::string();
+    for (unsigned I = 1; I < Call->getNumArgs(); ++I) {
+      if (!isa<CXXDefaultArgExpr>(Call->getArg(I)))
+        return std::string();
+    }
 
-  Finder.addMatcher(
-      callExpr(
-        callee(functionDecl(hasName("::QBasicAtomicInt::operator int")))
-      ).bind("call"), &AtomicCallback);
+    const Expr *Arg = Call->getArg(0);
+    std::string Text = getText(SourceManager, *Arg);
+    if (Text.empty() || Arg->getLocStart().isMacroID())
+      return std::string();
+
+    QualType Param = Call->getMethodDecl()->getParamDecl(0)->getType()
+                         .getNonReferenceType().getCanonicalType().getUnqualifiedType();
+    if (const CXXRecordDecl *Class = Param->getAsCXXRecordDecl()) {
+      std::string Name = Class->getQualifiedNameAsString();
+      if (Name == QStringClassName || Name == QLatin1StringClassName)
+        return Text;
+      if (Name == "QChar")
+        return QStringClassName "(" + Text + ")";
+      return std::string();
+    }
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
-}
+    // QString::number has the same overloads as arg() for these, and the
+    // same defaults, as long as the argument needs no conversion.
+    QualType Type = Arg->IgnoreImpCasts()->getType().getCanonicalType().getUnqualifiedType();
+    if (Numbers && Type == Param && !Param->isAnyCharacterType() &&
+        (Param->isIntegerType() || Param->isRealFloatingType()))
+      return QStringClassName "::number(" + Text + ")";
+    return std::string();
+  }
 
-int portQImageText(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+  std::map<std::string, Replacements> *Replace;
+};
 
-  ast_matchers::MatchFinder Finder;
+class PortStringRefs : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortStringRefs(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
 
-  RemoveArgument ImageTextCallback(&Tool.getReplacements());
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    if (const CXXMemberCallExpr *Call = Result.Nodes.getNodeAs<CXXMemberCallExpr>("call"))
+      portSubstring(Result, Call);
+    if (const CXXForRangeStmt *Loop = Result.Nodes.getNodeAs<CXXForRangeStmt>("loop"))
+      portSplit(Result, Loop);
+  }
 
-  Finder.addMatcher(
-      callExpr(
-        callee(functionDecl(hasName("::QImage::text"))),
-        hasArgument(
-          0,
-          expr().bind("prevArg")
-        ),
-        hasArgument(
-          1,
-          expr(clang::ast_matchers::integerLiteral(equals(0)).bind("arg"))
-        )
-      ).bind("call"), &ImageTextCallback);
+ private:
+  // s.mid(i, n) == "x" becomes s.midRef(i, n) == "x". QStringRef has all
+  // the read-only methods accepted here since Qt 5.1.
+  void portSubstring(const ast_matchers::MatchFinder::MatchResult &Result,
+                     const CXXMemberCallExpr *Call) {
+    if (Call->getLocStart().isMacroID() || Call->getLocEnd().isMacroID() ||
+        !onlyRead(*Result.Context, Call))
+      return;
+    if (!rename(*Result.SourceManager, cast<MemberExpr>(Call->getCallee())))
+      return;
 
-  Finder.addMatcher(
-      callExpr(
-        callee(functionDecl(hasName("::QImage::setText"))),
-        hasArgument(
-          0,
-          expr().bind("prevArg")
-        ),
-        hasArgument(
-          1,
-          expr(clang::ast_matchers::integerLiteral(equals(0)).bind("arg"))
-        )
-      ).bind("call"), &ImageTextCallback);
+    if (CreateIfdefs)
+      insertIfdef(Result.SourceManager, Call, Replace, "5, 1, 0");
+  }
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
-}
+  // for (const QString &Part : s.split(',')) becomes
+  // for (const QStringRef &Part : s.splitRef(',')) if Part is only read and
+  // s is a variable the loop leaves alone, as the parts point into it.
+  void portSplit(const ast_matchers::MatchFinder::MatchResult &Result,
+                 const CXXForRangeStmt *Loop) {
+    const SourceManager &SourceManager = *Result.SourceManager;
+    const CXXMemberCallExpr *Split = dyn_cast<CXXMemberCallExpr>(Loop->getRangeInit()->IgnoreImplicit());
+    const CXXMethodDecl *Method = Split ? Split->getMethodDecl() : nullptr;
+    if (!Method || Method->getQualifiedNameAsString() != QStringClassName "::split" ||
+        Loop->getLocStart().isMacroID() || Split->getLocStart().isMacroID() ||
+        Split->getLocEnd().isMacroID())
+      return;
 
-int portViewDataChanged(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+    const DeclRefExpr *String = dyn_cast<DeclRefExpr>(Split->getImplicitObjectArgument()->IgnoreImpCasts());
+    const VarDecl *Part = Loop->getLoopVariable();
+    if (!String || !isa<VarDecl>(String->getDecl()) || !isQString(Part->getType()))
+      return;
 
-  ast_matchers::MatchFinder Finder;
+    std::vector<const DeclRefExpr *> Uses;
+    references(Loop->getBody(), Part, Uses);
+    for (const DeclRefExpr *Use : Uses) {
+      if (!onlyRead(*Result.Context, Use))
+        return;
+    }
+    Uses.clear();
+    references(Loop->getBody(), String->getDecl(), Uses);
+    if (!Uses.empty())
+      return;
 
-  PortView2 ViewCallback2(&Tool.getReplacements());
+    // The #if copies whole lines, so the declaration and the call must share one.
+    if (CreateIfdefs && SourceManager.getSpellingLineNumber(Part->getLocStart()) !=
+                        SourceManager.getSpellingLineNumber(Split->getLocEnd()))
+      return;
 
-  Finder.addMatcher(
-      cxxMethodDecl(
-        hasName("dataChanged"),
-        ofClass(
-          allOf(
-            isDerivedFrom("QAbstractItemView"),
-            unless(hasName("QAbstractItemView"))
-          )
-        )
-      ).bind("funcDecl"), &ViewCallback2);
+    // An auto loop variable follows the new element type by itself.
+    if (!Part->getType()->getContainedAutoType()) {
+      TypeLoc Type = Part->getTypeSourceInfo()->getTypeLoc();
+      if (ReferenceTypeLoc Reference = Type.getAs<ReferenceTypeLoc>())
+        Type = Reference.getPointeeLoc();
+      Type = Type.getUnqualifiedLoc();
+      SourceLocation Name = Type.getBeginLoc();
+      if (Name.isMacroID() ||
+          Lexer::MeasureTokenLength(Name, SourceManager, Result.Context->getLangOpts()) != 7 ||
+          StringRef(SourceManager.getCharacterData(Name), 7) != QStringClassName)
+        return;
+      Utils::AddReplacement(
+        SourceManager.getFileEntryForID(SourceManager.getFileID(Name)),
+        Replacement(SourceManager, Name, 7, "QStringRef"),
+        Replace
+      );
+    }
+    rename(SourceManager, cast<MemberExpr>(Split->getCallee()));
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
-}
+    if (CreateIfdefs)
+      insertIfdef(Result.SourceManager, Split, Replace, "5, 4, 0");
+  }
 
-namespace clang {
-namespace ast_matchers {
-const internal::VariadicDynCastAllOfMatcher<clang::Decl, clang::EnumConstantDecl> enumeratorConstant;
-}
-}
+  // Appends the method name of Member with "Ref".
+  bool rename(const SourceManager &SourceManager, const MemberExpr *Member) {
+    SourceLocation Name = Member->getMemberLoc();
+    if (Name.isMacroID())
+      return false;
+    Utils::AddReplacement(
+      SourceManager.getFileEntryForID(SourceManager.getFileID(Name)),
+      Replacement(SourceManager, Name, Member->getMemberDecl()->getName().size(),
+                  Member->getMemberDecl()->getName().str() + "Ref"),
+      Replace
+    );
+    return true;
+  }
 
-int portEnum(const CompilationDatabase &Compilations)
-{
-  tooling::RefactoringTool Tool(Compilations, SourcePaths);
+  static bool isQString(QualType Type) {
+    const CXXRecordDecl *Class = Type.getNonReferenceType()->getAsCXXRecordDecl();
+    return Class && Class->getQualifiedNameAsString() == QStringClassName;
+  }
 
-  ast_matchers::MatchFinder Finder;
+  // Returns true if the QString E is only compared with a string or has
+  // a read-only method called that QStringRef has as well.
+  // QStringRef has the overloads that take strings and characters, but not
+  // the ones that take a QRegExp or a QRegularExpression.
+  static bool stringParameters(const CXXMethodDecl *Method) {
+    for (const ParmVarDecl *Parameter : Method->parameters()) {
+      const CXXRecordDecl *Class = Parameter->getType().getNonReferenceType()->getAsCXXRecordDecl();
+      if (!Class)
+        continue;
+      std::string Name = Class->getQualifiedNameAsString();
+      if (Name != QStringClassName && Name != QLatin1StringClassName && Name != "QStringRef" &&
+          Name != "QChar")
+        return false;
+    }
+    return true;
+  }
 
-  PortEnum Callback(&Tool.getReplacements());
+  static bool onlyRead(ASTContext &Context, const Expr *E) {
+    static const char *const Methods[] = {
+      "at", "compare", "contains", "count", "endsWith", "indexOf", "isEmpty", "isNull",
+      "lastIndexOf", "length", "size", "startsWith", "toDouble", "toFloat", "toInt",
+      "toLatin1", "toLong", "toLongLong", "toShort", "toUInt", "toULong", "toULongLong",
+      "toUShort", "toUtf8"
+    };
+
+    const Stmt *Child;
+    const Stmt *User = user(Context, E, Child);
+    if (const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User)) {
+      const CXXMemberCallExpr *Call = memberCall(Context, Member);
+      const CXXMethodDecl *Method = Call ? Call->getMethodDecl() : nullptr;
+      return Method && Method->getParent()->getQualifiedNameAsString() == QStringClassName &&
+             std::find(std::begin(Methods), std::end(Methods), Method->getName()) != std::end(Methods) &&
+             stringParameters(Method);
+    }
 
-  Finder.addMatcher(
+    const CXXOperatorCallExpr *Compare = dyn_cast_or_null<CXXOperatorCallExpr>(User);
+    if (!Compare || Compare->getNumArgs() != 2 ||
+        (Compare->getOperator() != OO_EqualEqual && Compare->getOperator() != OO_ExclaimEqual))
+      return false;
+    QualType Other = Compare->getArg(Compare->getArg(0) == Child ? 1 : 0)->IgnoreImplicit()->getType();
+    if (Other->isArrayType() || Other->isPointerType()) {
+      QualType Element = Other->isArrayType() ? Other->getAsArrayTypeUnsafe()->getElementType()
+                                              : Other->getPointeeType();
+      return Element->isCharType();
+    }
+    const CXXRecordDecl *Class = Other.getNonReferenceType()->getAsCXXRecordDecl();
+    if (!Class)
+      return false;
+    std::string Name = Class->getQualifiedNameAsString();
+    return Name == QStringClassName || Name == QLatin1StringClassName || Name == "QStringRef";
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class InsertReserve : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  InsertReserve(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // QVector<int> v;
+  // for (int i = 0; i < n; ++i)
+  //   v.append(i);
+  // gets v.reserve(n) before the loop. More or fewer appends than n only
+  // make the reservation less exact.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    const ForStmt *Loop =
+        Result.Nodes.getNodeAs<ForStmt>("loop");
+    ASTContext &Context = *Result.Context;
+    SourceManager &srcMgr = Context.getSourceManager();
+
+    const VarDecl *Counter = nullptr;
+    const Expr *Count = tripCount(Loop, Counter);
+    if (!Count || Loop->getLocStart().isMacroID() || Count->getLocStart().isMacroID() ||
+        Count->getLocEnd().isMacroID())
+      return;
+
+    // The container is declared by the statement right before the loop.
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*Loop);
+    const CompoundStmt *Block = Parents.size() == 1 ? Parents[0].get<CompoundStmt>() : nullptr;
+    if (!Block)
+      return;
+    const Stmt *Previous = nullptr;
+    for (const Stmt *S : Block->body()) {
+      if (S == Loop)
+        break;
+      Previous = S;
+    }
+    const DeclStmt *Declaration = dyn_cast_or_null<DeclStmt>(Previous);
+    const VarDecl *Container = Declaration && Declaration->isSingleDecl()
+                                   ? dyn_cast<VarDecl>(Declaration->getSingleDecl()) : nullptr;
+    if (!Container || !Container->hasLocalStorage() || !reservable(Container->getType()))
+      return;
+    const CXXConstructExpr *Construct = dyn_cast_or_null<CXXConstructExpr>(Container->getInit());
+    if (!Construct || Construct->getNumArgs() != 0)
+      return;
+
+    // The count must mean the same before the loop.
+    std::vector<const DeclRefExpr *> Uses;
+    references(Count, Container, Uses);
+    references(Count, Counter, Uses);
+    if (!Uses.empty())
+      return;
+
+    references(Loop->getBody(), Container, Uses);
+    if (Uses.empty())
+      return;
+    for (const DeclRefExpr *Use : Uses) {
+      if (!appends(Context, Use))
+        return;
+    }
+
+    std::string CountText = getText(srcMgr, *Count);
+    if (CountText.empty())
+      return;
+
+    // Indent the new line like the loop.
+    SourceLocation Begin = srcMgr.getSpellingLoc(Loop->getLocStart());
+    std::string Indent;
+    if (!indentation(srcMgr, Begin, Indent))
+      return;
+
+    Utils::AddReplacement(
+      srcMgr.getFileEntryForID(srcMgr.getFileID(Begin)),
+      Replacement(srcMgr, Begin, 0,
+                  Container->getName().str() + ".reserve(" + CountText + ");\n" + Indent),
+      Replace
+    );
+  }
+
+ private:
+  // Returns n of for (int i = 0; i < n; ++i), if it is a variable, constant
+  // or a call of a const method without arguments. Counter is set to i.
+  static const Expr *tripCount(const ForStmt *Loop, const VarDecl *&Counter) {
+    const DeclStmt *Init = dyn_cast_or_null<DeclStmt>(Loop->getInit());
+    Counter = Init && Init->isSingleDecl() ? dyn_cast<VarDecl>(Init->getSingleDecl()) : nullptr;
+    if (!Counter || !Counter->getType()->isIntegerType() || !Counter->getInit())
+      return nullptr;
+    const IntegerLiteral *Start = dyn_cast<IntegerLiteral>(Counter->getInit()->IgnoreParenImpCasts());
+    if (!Start || Start->getValue() != 0)
+      return nullptr;
+
+    const BinaryOperator *Condition = dyn_cast_or_null<BinaryOperator>(Loop->getCond());
+    if (!Condition || (Condition->getOpcode() != BO_LT && Condition->getOpcode() != BO_NE) ||
+        !isCounter(Condition->getLHS(), Counter))
+      return nullptr;
+
+    const UnaryOperator *Increment = dyn_cast_or_null<UnaryOperator>(Loop->getInc());
+    if (!Increment || !Increment->isIncrementOp() || !isCounter(Increment->getSubExpr(), Counter))
+      return nullptr;
+
+    const Expr *Count = Condition->getRHS()->IgnoreParenImpCasts();
+    return invariant(Count) ? Count : nullptr;
+  }
+
+  static bool isCounter(const Expr *E, const VarDecl *Counter) {
+    const DeclRefExpr *Ref = dyn_cast<DeclRefExpr>(E->IgnoreParenImpCasts());
+    return Ref && Ref->getDecl() == Counter;
+  }
+
+  static bool invariant(const Expr *E) {
+    E = E->IgnoreParenImpCasts();
+    if (isa<IntegerLiteral>(E) || isa<DeclRefExpr>(E))
+      return true;
+    if (const MemberExpr *Member = dyn_cast<MemberExpr>(E))
+      return isa<FieldDecl>(Member->getMemberDecl()) && invariant(Member->getBase());
+    if (const CXXMemberCallExpr *Call = dyn_cast<CXXMemberCallExpr>(E)) {
+      const CXXMethodDecl *Method = Call->getMethodDecl();
+      return Method && Method->isConst() && Call->getNumArgs() == 0 &&
+             invariant(Call->getImplicitObjectArgument());
+    }
+    return false;
+  }
+
+  static bool reservable(QualType Type) {
+    const CXXRecordDecl *Class = Type->getAsCXXRecordDecl();
+    if (!Class)
+      return false;
+    std::string Name = Class->getQualifiedNameAsString();
+    return Name == "QVector" || Name == "QList" || Name == "QStringList" ||
+           Name == QStringClassName || Name == "QByteArray";
+  }
+
+  // Returns true if Use is the object of append, push_back, << or +=.
+  static bool appends(ASTContext &Context, const DeclRefExpr *Use) {
+    const Stmt *Child;
+    const Stmt *User = user(Context, Use, Child);
+    if (const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User)) {
+      const CXXMemberCallExpr *Call = memberCall(Context, Member);
+      const CXXMethodDecl *Method = Call ? Call->getMethodDecl() : nullptr;
+      return Method && (Method->getName() == "append" || Method->getName() == "push_back");
+    }
+    const CXXOperatorCallExpr *Operator = dyn_cast_or_null<CXXOperatorCallExpr>(User);
+    return Operator && Operator->getNumArgs() == 2 && Operator->getArg(0) == Child &&
+           (Operator->getOperator() == OO_LessLess || Operator->getOperator() == OO_PlusEqual);
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+bool defaultConstructed(const Expr *Init) {
+  if (!Init)
+    return true;
+  const CXXConstructExpr *Construct = dyn_cast<CXXConstructExpr>(Init->IgnoreImplicit());
+  return Construct && Construct->getNumArgs() == 0;
+}
+
+// Appends every access to Field in S to Uses.
+void memberReferences(const Stmt *S, const FieldDecl *Field, std::vector<const Expr *> &Uses) {
+  if (!S)
+    return;
+  if (const MemberExpr *Member = dyn_cast<MemberExpr>(S)) {
+    if (Member->getMemberDecl() == Field)
+      Uses.push_back(Member);
+  }
+  for (const Stmt *Child : S->children())
+    memberReferences(Child, Field, Uses);
+}
+
+// Collects the uses of a local variable declared on its own in a function
+// that is not a template.
+bool localUses(ASTContext &Context, const VarDecl *Var, std::vector<const Expr *> &Uses) {
+  const FunctionDecl *Function = dyn_cast_or_null<FunctionDecl>(Var->getParentFunctionOrMethod());
+  if (!Var->isLocalVarDecl() || !Function || !Function->getBody() ||
+      Function->isDependentContext() || Function->isTemplateInstantiation())
+    return false;
+  ASTContext::DynTypedNodeList Parents = Context.getParents(*Var);
+  const DeclStmt *Statement = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+  if (!Statement || !Statement->isSingleDecl())
+    return false;
+
+  std::vector<const DeclRefExpr *> References;
+  references(Function->getBody(), Var, References);
+  Uses.insert(Uses.end(), References.begin(), References.end());
+  return true;
+}
+
+// Collects the uses of a private member if every method of its class is
+// defined in this TU, and nothing else can reach it: no friends, nested
+// classes or member templates, and no initialization from another container.
+bool memberUses(const FieldDecl *Field, std::vector<const Expr *> &Uses) {
+  const CXXRecordDecl *Class = dyn_cast<CXXRecordDecl>(Field->getParent());
+  if (!Class || Field->getAccess() != AS_private || Class->getDescribedClassTemplate() ||
+      isa<ClassTemplateSpecializationDecl>(Class) || Class->friend_begin() != Class->friend_end() ||
+      (Field->hasInClassInitializer() && !defaultConstructed(Field->getInClassInitializer())))
+    return false;
+  for (const Decl *Member : Class->decls()) {
+    if (isa<FunctionTemplateDecl>(Member) || (isa<CXXRecordDecl>(Member) && !Member->isImplicit()))
+      return false;
+  }
+  // A, B share one type; renaming it must suit both.
+  for (const FieldDecl *Other : Class->fields()) {
+    if (Other != Field && Other->getLocStart() == Field->getLocStart())
+      return false;
+  }
+
+  std::vector<const Stmt *> Code;
+  for (const CXXMethodDecl *Method : Class->methods()) {
+    if (Method->isImplicit() || Method->isDefaulted() || Method->isDeleted())
+      continue;
+    const FunctionDecl *Definition = nullptr;
+    if (!Method->hasBody(Definition)) {
+      if (Method->isPure())
+        continue;
+      return false;
+    }
+    Code.push_back(Definition->getBody());
+    if (const CXXConstructorDecl *Constructor = dyn_cast<CXXConstructorDecl>(Definition)) {
+      for (const CXXCtorInitializer *Init : Constructor->inits()) {
+        if (Init->getMember() == Field && !defaultConstructed(Init->getInit()))
+          return false;
+        Code.push_back(Init->getInit());
+      }
+    }
+  }
+  for (const Stmt *S : Code)
+    memberReferences(S, Field, Uses);
+  return true;
+}
+
+// Returns true if the value of E is not used.
+bool discarded(ASTContext &Context, const Expr *E) {
+  ASTContext::DynTypedNodeList Parents = Context.getParents(*E);
+  while (Parents.size() == 1 && Parents[0].get<ExprWithCleanups>())
+    Parents = Context.getParents(*Parents[0].get<ExprWithCleanups>());
+  return Parents.size() == 1 && Parents[0].get<Stmt>() && !Parents[0].get<Expr>();
+}
+
+// Returns the default constructed local ("var") or private member ("field")
+// that Result matched if all its uses can be seen, and collects them in Uses.
+const DeclaratorDecl *containerUses(const ast_matchers::MatchFinder::MatchResult &Result,
+                                    std::vector<const Expr *> &Uses) {
+  if (const VarDecl *Var = Result.Nodes.getNodeAs<VarDecl>("var"))
+    return defaultConstructed(Var->getInit()) && localUses(*Result.Context, Var, Uses) ? Var : nullptr;
+  if (const FieldDecl *Field = Result.Nodes.getNodeAs<FieldDecl>("field"))
+    return memberUses(Field, Uses) ? Field : nullptr;
+  return nullptr;
+}
+
+// Prints "Topic: file:line: Message" for what a rule found at Loc, once
+// however many TUs include it.
+void reportOnce(const char *Topic, const SourceManager &SourceManager, SourceLocation Loc,
+                const std::string &Message) {
+  static std::mutex Lock;
+  static std::set<std::string> Reported;
+  Loc = SourceManager.getSpellingLoc(Loc);
+  std::string Where = SourceManager.getFilename(Loc).str() + ":" +
+                      std::to_string(SourceManager.getSpellingLineNumber(Loc));
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (!Reported.insert(std::string(Topic) + Where + ":" +
+                       std::to_string(SourceManager.getSpellingColumnNumber(Loc))).second)
+    return;
+  llvm::errs() << Topic << ": " << Where << ": " << Message << "\n";
+}
+
+// Returns true if the file of Loc sees Definition in every TU that
+// includes it: it is the main file, or Definition was reached through its
+// own #includes. A header that only compiles because this TU included
+// something before it does not count.
+bool includedFrom(const SourceManager &SourceManager, SourceLocation Definition, SourceLocation Loc) {
+  FileID File = SourceManager.getFileID(SourceManager.getExpansionLoc(Loc));
+  if (File == SourceManager.getMainFileID())
+    return true;
+  FileID Including = SourceManager.getFileID(SourceManager.getExpansionLoc(Definition));
+  while (Including.isValid() && Including != File) {
+    SourceLocation Include = SourceManager.getIncludeLoc(Including);
+    Including = Include.isValid() ? SourceManager.getFileID(Include) : FileID();
+  }
+  return Including == File;
+}
+
+// Returns true if the class or class template Name is defined in Scope
+// before Loc, and visible wherever the file of Loc is compiled. Names in
+// inline namespaces are found in the enclosing one, too.
+bool definedBefore(ASTContext &Context, const DeclContext *Scope, StringRef Name,
+                   SourceLocation Loc) {
+  const SourceManager &SourceManager = Context.getSourceManager();
+  DeclarationName Identifier(&Context.Idents.get(Name));
+  for (NamedDecl *Candidate : Scope->lookup(Identifier)) {
+    const CXXRecordDecl *Class = dyn_cast<CXXRecordDecl>(Candidate);
+    if (const ClassTemplateDecl *Template = dyn_cast<ClassTemplateDecl>(Candidate))
+      Class = Template->getTemplatedDecl();
+    const CXXRecordDecl *Definition = Class ? Class->getDefinition() : nullptr;
+    if (Definition &&
+        SourceManager.isBeforeInTranslationUnit(Definition->getLocation(), Loc) &&
+        includedFrom(SourceManager, Definition->getLocation(), Loc))
+      return true;
+  }
+  return false;
+}
+
+class PortMapToHash : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortMapToHash(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // A QMap local or private member becomes a QHash when all the code that
+  // can touch it is in this TU and only looks up, inserts and removes keys.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    SourceManager &srcMgr = Context.getSourceManager();
+
+    std::vector<const Expr *> Uses;
+    const DeclaratorDecl *Declared = containerUses(Result, Uses);
+    if (!Declared)
+      return;
+    for (const Expr *Use : Uses) {
+      if (!unordered(Context, Use))
+        return;
+    }
+
+    const ClassTemplateSpecializationDecl *Map =
+        dyn_cast_or_null<ClassTemplateSpecializationDecl>(Declared->getType()->getAsCXXRecordDecl());
+    if (!Map || Map->getTemplateArgs().size() < 1 ||
+        !hashable(Context, Map->getTemplateArgs()[0].getAsType()) ||
+        !definedBefore(Context, Context.getTranslationUnitDecl(), "QHash", Declared->getLocStart()))
+      return;
+
+    TypeLoc Type = Declared->getTypeSourceInfo()->getTypeLoc().getUnqualifiedLoc();
+    TemplateSpecializationTypeLoc Specialization = Type.getAs<TemplateSpecializationTypeLoc>();
+    if (!Specialization)
+      return;
+    SourceLocation Name = Specialization.getTemplateNameLoc();
+    if (Name.isMacroID() ||
+        Lexer::MeasureTokenLength(Name, srcMgr, Context.getLangOpts()) != 4 ||
+        StringRef(srcMgr.getCharacterData(Name), 4) != "QMap")
+      return;
+
+    // QHash exists in Qt 4 as well, so no #if is needed.
+    Utils::AddReplacement(
+      srcMgr.getFileEntryForID(srcMgr.getFileID(Name)),
+      Replacement(srcMgr, Name, 4, "QHash"),
+      Replace
+    );
+  }
+
+ private:
+  // Returns true if the map E is only used in a way that does not depend on
+  // the order of its keys and means the same for a QHash. Iteration, keys(),
+  // firstKey(), lowerBound(), copies and passing it on all keep the QMap.
+  static bool unordered(ASTContext &Context, const Expr *E) {
+    static const char *const Methods[] = {
+      "clear", "contains", "count", "isEmpty", "remove", "size", "take", "value"
+    };
+
+    const Stmt *Child;
+    const Stmt *User = user(Context, E, Child);
+    if (const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User)) {
+      const CXXMemberCallExpr *Call = memberCall(Context, Member);
+      const CXXMethodDecl *Method = Call ? Call->getMethodDecl() : nullptr;
+      if (!Method)
+        return false;
+      // QMap::insert returns a QMap iterator.
+      if (Method->getName() == "insert")
+        return discarded(Context, Call);
+      return std::find(std::begin(Methods), std::end(Methods), Method->getName()) != std::end(Methods);
+    }
+    const CXXOperatorCallExpr *Subscript = dyn_cast_or_null<CXXOperatorCallExpr>(User);
+    return Subscript && Subscript->getOperator() == OO_Subscript && Subscript->getArg(0) == Child;
+  }
+
+  // Qt hashes integers, unscoped enums and pointers; classes need a qHash
+  // overload in the global namespace or their own.
+  static bool hashable(ASTContext &Context, QualType Key) {
+    Key = Key.getCanonicalType();
+    if (Key->isIntegralOrUnscopedEnumerationType() || Key->isPointerType())
+      return true;
+    const CXXRecordDecl *Class = Key->getAsCXXRecordDecl();
+    if (!Class)
+      return false;
+    DeclarationName Name(&Context.Idents.get("qHash"));
+    const DeclContext *Scopes[] = { Context.getTranslationUnitDecl(), Class->getEnclosingNamespaceContext() };
+    for (const DeclContext *Scope : Scopes) {
+      for (NamedDecl *Candidate : Scope->lookup(Name)) {
+        const FunctionDecl *Hash = Candidate->getAsFunction();
+        if (!Hash || Hash->getNumParams() < 1)
+          continue;
+        const CXXRecordDecl *Param = Hash->getParamDecl(0)->getType().getNonReferenceType()->getAsCXXRecordDecl();
+        if (Param && Param->getCanonicalDecl() == Class->getCanonicalDecl())
+          return true;
+      }
+    }
+    return false;
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class PortSequence : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortSequence(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // Picks the container for a QLinkedList or QList local or private member
+  // from the ways it is accessed:
+  //   QLinkedList, appended to and read:                  QVector
+  //   QLinkedList or QList, also taken from the front:    std::deque
+  //   QLinkedList, also inserted into by iterator:        std::list
+  // Iterating with begin() and end() leaves the choice to the other accesses,
+  // unless the list changes while an iterator is held: only std::list keeps
+  // it valid then. A QList inserted into or erased from stays, as
+  // std::deque is no cheaper in the middle. Each container looked at is
+  // reported with its accesses and the outcome.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    SourceManager &srcMgr = Context.getSourceManager();
+
+    std::vector<const Expr *> Uses;
+    const DeclaratorDecl *Declared = containerUses(Result, Uses);
+    if (!Declared)
+      return;
+    const CXXRecordDecl *Class = Declared->getType()->getAsCXXRecordDecl();
+    bool Linked = Class->getName() == "QLinkedList";
+
+    unsigned Accesses = 0;
+    bool Operators = false;
+    std::set<std::string> Names;
+    std::vector<std::pair<const CXXMemberCallExpr *, const Operation *> > Calls;
+    std::vector<SourceRange> Held;
+    std::vector<SourceLocation> Changes;
+    for (const Expr *Use : Uses) {
+      const CXXMemberCallExpr *Call = nullptr;
+      const Operation *Op = nullptr;
+      std::string Name;
+      SourceRange Live;
+      unsigned Kind = access(Context, Use, Declared, Call, Op, Name, Live);
+      Names.insert(Name);
+      if (!Kind) {
+        if (Linked)
+          report(srcMgr, Declared, Names, "kept for " + Name);
+        return;
+      }
+      Accesses |= Kind;
+      if (Op)
+        Calls.push_back(std::make_pair(Call, Op));
+      else if (Kind == End)
+        Operators = true;
+      if (Live.isValid())
+        Held.push_back(Live);
+      if (Kind & (End | Front | Middle))
+        Changes.push_back(Use->getLocStart());
+    }
+    for (const SourceRange &Live : Held) {
+      for (SourceLocation Change : Changes) {
+        if (!srcMgr.isBeforeInTranslationUnit(Change, Live.getBegin()) &&
+            srcMgr.isBeforeInTranslationUnit(Change, Live.getEnd()))
+          Accesses |= Middle;
+      }
+    }
+
+    std::string Target;
+    if (Accesses & Middle)
+      Target = Linked ? "std::list" : "";
+    else if (Accesses & Front)
+      Target = "std::deque";
+    else if (Linked)
+      Target = "QVector";
+    if (Target.empty()) {
+      if (Linked || (Accesses & Front))
+        report(srcMgr, Declared, Names, "kept");
+      return;
+    }
+    bool Std = StringRef(Target).startswith("std::");
+    if (Std && Operators) {
+      report(srcMgr, Declared, Names, "kept for the operators");
+      return;
+    }
+
+    const DeclContext *Scope = Context.getTranslationUnitDecl();
+    if (Std) {
+      Scope = nullptr;
+      for (NamedDecl *Candidate : Context.getTranslationUnitDecl()->lookup(&Context.Idents.get("std"))) {
+        if (isa<NamespaceDecl>(Candidate))
+          Scope = cast<NamespaceDecl>(Candidate);
+      }
+    }
+    StringRef Template = Std ? StringRef(Target).substr(5) : StringRef(Target);
+    if (!Scope || !definedBefore(Context, Scope, Template, Declared->getLocStart())) {
+      report(srcMgr, Declared, Names, "kept, " + Target + " is not included");
+      return;
+    }
+
+    TypeLoc Type = Declared->getTypeSourceInfo()->getTypeLoc().getUnqualifiedLoc();
+    TemplateSpecializationTypeLoc Specialization = Type.getAs<TemplateSpecializationTypeLoc>();
+    if (!Specialization)
+      return;
+    SourceLocation Name = Specialization.getTemplateNameLoc();
+    unsigned Length = Class->getName().size();
+    if (Name.isMacroID() ||
+        Lexer::MeasureTokenLength(Name, srcMgr, Context.getLangOpts()) != Length ||
+        StringRef(srcMgr.getCharacterData(Name), Length) != Class->getName())
+      return;
+
+    std::vector<std::pair<SourceLocation, Replacement> > Edits;
+    Edits.push_back(std::make_pair(Name, Replacement(srcMgr, Name, Length, Target)));
+    // The standard containers have the methods used here under other names.
+    // QVector has them all, but removeLast() and takeLast() only since
+    // Qt 5.1, so those get the standard names, which Qt 4 has too.
+    for (size_t I = 0; I < Calls.size(); ++I) {
+      const CXXMemberCallExpr *Call = Calls[I].first;
+      const Operation *Op = Calls[I].second;
+      if (!Std && !Op->Qt51)
+        continue;
+      SourceLocation Method = cast<MemberExpr>(Call->getCallee())->getMemberLoc();
+      StringRef Old = Call->getMethodDecl()->getName();
+      if (Method.isMacroID())
+        return;
+      if (Old != Op->Std)
+        Edits.push_back(std::make_pair(Method, Replacement(srcMgr, Method, Old.size(), Op->Std)));
+      if (Op->Pop && !popAfter(Context, Call, Op->Pop, Edits)) {
+        report(srcMgr, Declared, Names, "kept, " + Old.str() + " is not a statement of its own");
+        return;
+      }
+    }
+
+    report(srcMgr, Declared, Names, Target);
+    // These containers and the methods called exist with Qt 4 as well, so
+    // no #if is needed.
+    for (const auto &Edit : Edits) {
+      Utils::AddReplacement(
+        srcMgr.getFileEntryForID(srcMgr.getFileID(Edit.first)),
+        Edit.second,
+        Replace
+      );
+    }
+  }
+
+ private:
+  enum Access { Read = 1, End = 2, Front = 4, Middle = 8, Iterate = 16 };
+
+  struct Operation {
+    const char *Name;
+    Access Kind;
+    // The name in the standard containers, and for take*(), the call that
+    // removes the element afterwards.
+    const char *Std;
+    const char *Pop;
+    // QVector only has it since Qt 5.1.
+    bool Qt51;
+  };
+
+  // Returns the kind of access Use makes, or 0 if it is none of them.
+  // Call and Op are set for method calls, Name describes the access, and
+  // Live is where an iterator it returns is held.
+  static unsigned access(ASTContext &Context, const Expr *Use, const DeclaratorDecl *Declared,
+                         const CXXMemberCallExpr *&Call, const Operation *&Op, std::string &Name,
+                         SourceRange &Live) {
+    static const Operation Operations[] = {
+      { "append", End, "push_back", nullptr, false },
+      { "push_back", End, "push_back", nullptr, false },
+      { "removeLast", End, "pop_back", nullptr, true },
+      { "pop_back", End, "pop_back", nullptr, false },
+      { "takeLast", End, "back", "pop_back", true },
+      { "clear", End, "clear", nullptr, false },
+      { "first", Read, "front", nullptr, false },
+      { "front", Read, "front", nullptr, false },
+      { "last", Read, "back", nullptr, false },
+      { "back", Read, "back", nullptr, false },
+      { "isEmpty", Read, "empty", nullptr, false },
+      { "empty", Read, "empty", nullptr, false },
+      { "size", Read, "size", nullptr, false },
+      { "count", Read, "size", nullptr, false },
+      { "prepend", Front, "push_front", nullptr, false },
+      { "push_front", Front, "push_front", nullptr, false },
+      { "removeFirst", Front, "pop_front", nullptr, false },
+      { "pop_front", Front, "pop_front", nullptr, false },
+      { "takeFirst", Front, "front", "pop_front", false },
+      { "insert", Middle, "insert", nullptr, false },
+      { "erase", Middle, "erase", nullptr, false },
+      { "begin", Iterate, "begin", nullptr, false },
+      { "end", Iterate, "end", nullptr, false },
+      { "constBegin", Iterate, "cbegin", nullptr, false },
+      { "constEnd", Iterate, "cend", nullptr, false }
+    };
+
+    const Stmt *Child;
+    const Stmt *User = user(Context, Use, Child);
+    if (const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User)) {
+      Name = Member->getMemberDecl()->getNameAsString();
+      Call = memberCall(Context, Member);
+      if (!Call)
+        return 0;
+      for (const Operation &Candidate : Operations) {
+        if (Name == Candidate.Name)
+          Op = &Candidate;
+      }
+      // count(value) has no counterpart.
+      if (!Op || (Name == "count" && Call->getNumArgs() != 0))
+        return 0;
+      if (Op->Kind == Iterate && !localIterator(Context, Call, Live))
+        return 0;
+      return Op->Kind;
+    }
+
+    if (const CXXOperatorCallExpr *Operator = dyn_cast_or_null<CXXOperatorCallExpr>(User)) {
+      Name = std::string("operator") + getOperatorSpelling(Operator->getOperator());
+      if (Operator->getNumArgs() != 2 || Operator->getArg(0) != Child ||
+          (Operator->getOperator() != OO_LessLess && Operator->getOperator() != OO_PlusEqual))
+        return 0;
+      // Appending another list of the old type would not compile.
+      const CXXRecordDecl *Other = Operator->getArg(1)->getType()->getAsCXXRecordDecl();
+      return Other && Other == Declared->getType()->getAsCXXRecordDecl() ? 0 : End;
+    }
+
+    // for (... : list) is a read if the loop leaves the list alone.
+    Name = "other use";
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*Child);
+    const VarDecl *Range = Parents.size() == 1 ? Parents[0].get<VarDecl>() : nullptr;
+    if (!Range)
+      return 0;
+    Parents = Context.getParents(*Range);
+    const DeclStmt *RangeStmt = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+    if (!RangeStmt)
+      return 0;
+    Parents = Context.getParents(*RangeStmt);
+    const CXXForRangeStmt *Loop = Parents.size() == 1 ? Parents[0].get<CXXForRangeStmt>() : nullptr;
+    if (!Loop || Loop->getRangeStmt() != RangeStmt)
+      return 0;
+    Name = "for";
+    std::vector<const Expr *> Inside;
+    if (const FieldDecl *Field = dyn_cast<FieldDecl>(Declared)) {
+      memberReferences(Loop->getBody(), Field, Inside);
+    } else {
+      std::vector<const DeclRefExpr *> References;
+      references(Loop->getBody(), Declared, References);
+      Inside.insert(Inside.end(), References.begin(), References.end());
+    }
+    return Inside.empty() ? Read : 0;
+  }
+
+  // Returns true if the iterator Call returns is only kept in an auto
+  // variable, passed to the container's own methods or compared, so that
+  // nothing spells out the old iterator type. Live is set to the scope of
+  // the variable: the for statement it is declared in, or the rest of its
+  // block.
+  static bool localIterator(ASTContext &Context, const CXXMemberCallExpr *Call, SourceRange &Live) {
+    const Stmt *Child;
+    const Stmt *User = user(Context, Call, Child);
+    // Iterators are passed and stored by value.
+    while (User && isa<CXXConstructExpr>(User))
+      User = user(Context, cast<Expr>(User), Child);
+    if (!User) {
+      ASTContext::DynTypedNodeList Parents = Context.getParents(*Child);
+      const VarDecl *Iterator = Parents.size() == 1 ? Parents[0].get<VarDecl>() : nullptr;
+      if (!Iterator || !Iterator->getType()->getContainedAutoType())
+        return false;
+      Parents = Context.getParents(*Iterator);
+      const DeclStmt *Statement = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+      if (!Statement)
+        return false;
+      Parents = Context.getParents(*Statement);
+      if (Parents.size() != 1)
+        return false;
+      if (const ForStmt *Loop = Parents[0].get<ForStmt>())
+        Live = Loop->getSourceRange();
+      else if (const CompoundStmt *Block = Parents[0].get<CompoundStmt>())
+        Live = SourceRange(Statement->getLocStart(), Block->getLocEnd());
+      return Live.isValid();
+    }
+    if (const CXXMemberCallExpr *Method = dyn_cast<CXXMemberCallExpr>(User))
+      return Method->getMethodDecl() &&
+             Method->getMethodDecl()->getParent() == Call->getMethodDecl()->getParent();
+    const CXXOperatorCallExpr *Compare = dyn_cast<CXXOperatorCallExpr>(User);
+    return Compare && (Compare->getOperator() == OO_EqualEqual ||
+                       Compare->getOperator() == OO_ExclaimEqual);
+  }
+
+  // T x = list.takeFirst(); becomes T x = list.front(); list.pop_front();
+  // which needs the call to be all of the initializer or the right-hand
+  // side of an assignment in a statement of its own.
+  static bool popAfter(ASTContext &Context, const CXXMemberCallExpr *Call, const char *Pop,
+                       std::vector<std::pair<SourceLocation, Replacement> > &Edits) {
+    SourceManager &SourceManager = Context.getSourceManager();
+    const LangOptions &LangOpts = Context.getLangOpts();
+
+    SourceLocation Begin, End;
+    ast_type_traits::DynTypedNode Node = ast_type_traits::DynTypedNode::create(*static_cast<const Stmt *>(Call));
+    for (;;) {
+      ASTContext::DynTypedNodeList Parents = Context.getParents(Node);
+      if (Parents.size() != 1)
+        return false;
+      if (const VarDecl *Var = Parents[0].get<VarDecl>()) {
+        // const T &x = list.takeFirst(); keeps the taken element alive,
+        // list.front() would leave x dangling after the pop.
+        if (Var->getType()->isReferenceType())
+          return false;
+        Parents = Context.getParents(*Var);
+        const DeclStmt *Statement = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+        if (!Statement || !Statement->isSingleDecl() || !inBlock(Context, Statement))
+          return false;
+        Begin = Statement->getLocStart();
+        End = Lexer::getLocForEndOfToken(Statement->getLocEnd(), 0, SourceManager, LangOpts);
+        break;
+      }
+      const Expr *Parent = Parents[0].get<Expr>();
+      if (!Parent)
+        return false;
+      const BinaryOperator *Assign = dyn_cast<BinaryOperator>(Parent);
+      const CXXOperatorCallExpr *AssignOperator = dyn_cast<CXXOperatorCallExpr>(Parent);
+      if ((Assign && Assign->getOpcode() == BO_Assign) ||
+          (AssignOperator && AssignOperator->getOperator() == OO_Equal)) {
+        if (!inBlock(Context, Parent))
+          return false;
+        Begin = Parent->getLocStart();
+        End = Lexer::findLocationAfterToken(Parent->getLocEnd(), tok::semi, SourceManager, LangOpts, false);
+        break;
+      }
+      if (!(isa<ImplicitCastExpr>(Parent) || isa<MaterializeTemporaryExpr>(Parent) ||
+            isa<CXXBindTemporaryExpr>(Parent) || isa<CXXConstructExpr>(Parent)))
+        return false;
+      Node = Parents[0];
+    }
+
+    std::string Indent;
+    std::string Object = getText(SourceManager, *Call->getImplicitObjectArgument());
+    if (Begin.isMacroID() || End.isInvalid() || End.isMacroID() || Object.empty() ||
+        !indentation(SourceManager, Begin, Indent))
+      return false;
+    bool Arrow = cast<MemberExpr>(Call->getCallee())->isArrow();
+    Edits.push_back(std::make_pair(End, Replacement(SourceManager, End, 0,
+        "\n" + Indent + Object + (Arrow ? "->" : ".") + Pop + "();")));
+    return true;
+  }
+
+  // Returns true if S is a statement directly in a block.
+  static bool inBlock(ASTContext &Context, const Stmt *S) {
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*S);
+    while (Parents.size() == 1 && Parents[0].get<ExprWithCleanups>())
+      Parents = Context.getParents(*Parents[0].get<ExprWithCleanups>());
+    return Parents.size() == 1 && Parents[0].get<CompoundStmt>();
+  }
+
+  // Prints one line per container and TU: the accesses found and what
+  // became of it.
+  static void report(const SourceManager &SourceManager, const DeclaratorDecl *Declared,
+                     const std::set<std::string> &Names, const std::string &Outcome) {
+    std::string Accesses;
+    for (const std::string &Name : Names)
+      Accesses += (Accesses.empty() ? "" : ", ") + Name;
+    reportOnce("containers", SourceManager, Declared->getLocation(),
+               Declared->getType()->getAsCXXRecordDecl()->getName().str() + " " +
+               Declared->getNameAsString() + " (" + Accesses + "): " + Outcome);
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class PortDynamicCast : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortDynamicCast(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // dynamic_cast<T *>(object) becomes qobject_cast<T *>(object) when both
+  // classes have Q_OBJECT. Every dynamic_cast left and every typeid is
+  // reported on an "rtti:" line, as they keep the code from building
+  // without RTTI.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    SourceManager &srcMgr = *Result.SourceManager;
+
+    if (const CXXTypeidExpr *Typeid = Result.Nodes.getNodeAs<CXXTypeidExpr>("typeid")) {
+      reportOnce("rtti", srcMgr, Typeid->getLocStart(), "typeid");
+      return;
+    }
+
+    const CXXDynamicCastExpr *Cast = Result.Nodes.getNodeAs<CXXDynamicCastExpr>("cast");
+    std::string Written = "dynamic_cast<" + Cast->getTypeAsWritten().getAsString() + ">";
+    std::string Reason = unsupported(Cast);
+    SourceLocation Keyword = Cast->getOperatorLoc();
+    if (Reason.empty() && Keyword.isMacroID())
+      Reason = "in a macro";
+    if (!Reason.empty()) {
+      reportOnce("rtti", srcMgr, Keyword, Written + ": " + Reason);
+      return;
+    }
+
+    // qobject_cast exists in Qt 4, so no #if is needed.
+    Utils::AddReplacement(
+      srcMgr.getFileEntryForID(srcMgr.getFileID(Keyword)),
+      Replacement(srcMgr, Keyword, StringRef("dynamic_cast").size(), "qobject_cast"),
+      Replace
+    );
+  }
+
+ private:
+  // Returns why the cast cannot be a qobject_cast, or nothing if it can.
+  static std::string unsupported(const CXXDynamicCastExpr *Cast) {
+    QualType Target = Cast->getTypeAsWritten();
+    QualType Source = Cast->getSubExpr()->getType();
+    if (Target->isDependentType() || Source->isDependentType())
+      return "in a template";
+    if (!Target->isPointerType() || !Source->isPointerType())
+      return "not a pointer";
+    if (Target->getPointeeType().isVolatileQualified() || Source->getPointeeType().isVolatileQualified())
+      return "volatile";
+    const CXXRecordDecl *To = Target->getPointeeCXXRecordDecl();
+    const CXXRecordDecl *From = Source->getPointeeCXXRecordDecl();
+    if (!To || !From)
+      return "not a class";
+    if (!hasQObjectMacro(From))
+      return From->getNameAsString() + " has no Q_OBJECT";
+    if (!hasQObjectMacro(To))
+      return To->getNameAsString() + " has no Q_OBJECT";
+    return "";
+  }
+
+  // Q_OBJECT declares qt_metacast() in the class itself; Q_GADGET and the
+  // classes that only inherit Q_OBJECT do not. qobject_cast to a class
+  // without it silently checks for the nearest base that has it.
+  static bool hasQObjectMacro(const CXXRecordDecl *Class) {
+    Class = Class->getDefinition();
+    if (!Class)
+      return false;
+    for (const NamedDecl *Member : Class->lookup(&Class->getASTContext().Idents.get("qt_metacast"))) {
+      if (isa<CXXMethodDecl>(Member))
+        return true;
+    }
+    return false;
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class PortTimer : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortTimer(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // Rewrites the ways to measure time with the wall clock:
+  //   QTime t; t.start(); ... t.elapsed()    QElapsedTimer t; ...
+  //   QDateTime s = QDateTime::currentDateTime(); ...
+  //   s.msecsTo(QDateTime::currentDateTime())
+  //                                          qint64 s = QDateTime::currentMSecsSinceEpoch(); ...
+  //                                          (QDateTime::currentMSecsSinceEpoch() - s)
+  //   QDateTime::currentDateTime().toMSecsSinceEpoch()
+  //                                          QDateTime::currentMSecsSinceEpoch()
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    SourceManager &srcMgr = Context.getSourceManager();
+
+    std::vector<std::pair<SourceLocation, Replacement> > Edits;
+    if (const CXXMemberCallExpr *Epoch = Result.Nodes.getNodeAs<CXXMemberCallExpr>("epoch")) {
+      const CallExpr *Now = currentDateTime(Epoch->getImplicitObjectArgument());
+      if (!Now || !hasEpochClock(Now))
+        return;
+      SourceRange Range = Epoch->getSourceRange();
+      if (Range.getBegin().isMacroID() || Range.getEnd().isMacroID())
+        return;
+      CharSourceRange Chars = CharSourceRange::getTokenRange(Range);
+      Edits.push_back(std::make_pair(Range.getBegin(),
+          Replacement(srcMgr, Chars, "QDateTime::currentMSecsSinceEpoch()")));
+    } else if (const VarDecl *Var = Result.Nodes.getNodeAs<VarDecl>("time")) {
+      std::vector<const Expr *> Uses;
+      if (!defaultConstructed(Var->getInit()) || !localUses(Context, Var, Uses) || Uses.empty() ||
+          !definedBefore(Context, Context.getTranslationUnitDecl(), "QElapsedTimer", Var->getLocStart()))
+        return;
+      for (const Expr *Use : Uses) {
+        const Stmt *Child;
+        const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(user(Context, Use, Child));
+        const CXXMemberCallExpr *Call = Member ? memberCall(Context, Member) : nullptr;
+        StringRef Method = Call && Call->getMethodDecl() ? Call->getMethodDecl()->getName() : "";
+        if (Method != "start" && Method != "restart" && Method != "elapsed")
+          return;
+      }
+      if (!renameType(Context, Var, "QTime", "QElapsedTimer", Edits))
+        return;
+    } else if (const VarDecl *Var = Result.Nodes.getNodeAs<VarDecl>("datetime")) {
+      std::vector<const Expr *> Uses;
+      const CallExpr *Init = Var->getInit() ? currentDateTime(Var->getInit()) : nullptr;
+      if (!Init || !hasEpochClock(Init) || !localUses(Context, Var, Uses) ||
+          !renameNow(srcMgr, Init, Edits) || !renameType(Context, Var, "QDateTime", "qint64", Edits))
+        return;
+      for (const Expr *Use : Uses) {
+        if (!sinceEpoch(Context, Var, Use, Edits))
+          return;
+      }
+    }
+
+    // QElapsedTimer and currentMSecsSinceEpoch() are in Qt 4.7 already, so
+    // no #if is needed.
+    for (const auto &Edit : Edits) {
+      Utils::AddReplacement(
+        srcMgr.getFileEntryForID(srcMgr.getFileID(Edit.first)),
+        Edit.second,
+        Replace
+      );
+    }
+  }
+
+ private:
+  // Returns the call of QDateTime::currentDateTime() E is, if any.
+  static const CallExpr *currentDateTime(const Expr *E) {
+    E = E->IgnoreImplicit();
+    while (const CXXConstructExpr *Copy = dyn_cast<CXXConstructExpr>(E)) {
+      if (Copy->getNumArgs() != 1)
+        return nullptr;
+      E = Copy->getArg(0)->IgnoreImplicit();
+    }
+    const CallExpr *Call = dyn_cast<CallExpr>(E->IgnoreParens());
+    const CXXMethodDecl *Method = Call ? dyn_cast_or_null<CXXMethodDecl>(Call->getDirectCallee()) : nullptr;
+    return Method && Method->isStatic() && Method->getName() == "currentDateTime" &&
+           Method->getParent()->getName() == "QDateTime" ? Call : nullptr;
+  }
+
+  // Returns true if the QDateTime Now belongs to has currentMSecsSinceEpoch().
+  static bool hasEpochClock(const CallExpr *Now) {
+    const CXXRecordDecl *Class = cast<CXXMethodDecl>(Now->getDirectCallee())->getParent();
+    return !Class->lookup(&Class->getASTContext().Idents.get("currentMSecsSinceEpoch")).empty();
+  }
+
+  // Turns QDateTime::currentDateTime() into QDateTime::currentMSecsSinceEpoch().
+  static bool renameNow(const SourceManager &SourceManager, const CallExpr *Now,
+                        std::vector<std::pair<SourceLocation, Replacement> > &Edits) {
+    const DeclRefExpr *Callee = dyn_cast<DeclRefExpr>(Now->getCallee()->IgnoreImplicit());
+    if (!Callee || Callee->getLocation().isMacroID())
+      return false;
+    Edits.push_back(std::make_pair(Callee->getLocation(),
+        Replacement(SourceManager, Callee->getLocation(), StringRef("currentDateTime").size(),
+                    "currentMSecsSinceEpoch")));
+    return true;
+  }
+
+  // Replaces the class name Old in the declared type of Var by New. An auto
+  // variable is left as it is.
+  static bool renameType(ASTContext &Context, const VarDecl *Var, StringRef Old, StringRef New,
+                         std::vector<std::pair<SourceLocation, Replacement> > &Edits) {
+    if (Var->getType()->getContainedAutoType())
+      return true;
+    TypeLoc Type = Var->getTypeSourceInfo()->getTypeLoc().getUnqualifiedLoc();
+    if (ElaboratedTypeLoc Elaborated = Type.getAs<ElaboratedTypeLoc>()) {
+      if (Elaborated.getQualifierLoc())
+        return false;
+      Type = Elaborated.getNamedTypeLoc();
+    }
+    SourceLocation Name = Type.getBeginLoc();
+    const SourceManager &SourceManager = Context.getSourceManager();
+    if (!Type.getAs<RecordTypeLoc>() || Name.isMacroID() ||
+        Lexer::MeasureTokenLength(Name, SourceManager, Context.getLangOpts()) != Old.size() ||
+        StringRef(SourceManager.getCharacterData(Name), Old.size()) != Old)
+      return false;
+    Edits.push_back(std::make_pair(Name, Replacement(SourceManager, Name, Old.size(), New)));
+    return true;
+  }
+
+  // Rewrites a use of the QDateTime Var that became a qint64: it may be
+  // set to currentDateTime() again, or give the time since with msecsTo().
+  static bool sinceEpoch(ASTContext &Context, const VarDecl *Var, const Expr *Use,
+                         std::vector<std::pair<SourceLocation, Replacement> > &Edits) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    const Stmt *Child;
+    const Stmt *User = user(Context, Use, Child);
+    if (const CXXOperatorCallExpr *Assign = dyn_cast_or_null<CXXOperatorCallExpr>(User)) {
+      const CallExpr *Now = Assign->getNumArgs() == 2 ? currentDateTime(Assign->getArg(1)) : nullptr;
+      return Assign->getOperator() == OO_Equal && Assign->getArg(0) == Child && Now &&
+             renameNow(SourceManager, Now, Edits);
+    }
+
+    const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User);
+    const CXXMemberCallExpr *Call = Member ? memberCall(Context, Member) : nullptr;
+    if (!Call || !Call->getMethodDecl() || Call->getMethodDecl()->getName() != "msecsTo" ||
+        Call->getNumArgs() != 1 || !currentDateTime(Call->getArg(0)))
+      return false;
+    SourceRange Range = Call->getSourceRange();
+    if (Range.getBegin().isMacroID() || Range.getEnd().isMacroID())
+      return false;
+    Edits.push_back(std::make_pair(Range.getBegin(),
+        Replacement(SourceManager, CharSourceRange::getTokenRange(Range),
+                    "(QDateTime::currentMSecsSinceEpoch() - " + Var->getNameAsString() + ")")));
+    return true;
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class PortSignalMapper : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortSignalMapper(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace), Sources(nullptr) {}
+
+  // A local QSignalMapper set up as
+  //   QSignalMapper *mapper = new QSignalMapper(this);
+  //   connect(button, SIGNAL(clicked()), mapper, SLOT(map()));
+  //   mapper->setMapping(button, i);
+  //   connect(mapper, SIGNAL(mapped(int)), this, SLOT(select(int)));
+  // is replaced by one connection per sender to a lambda with the value:
+  //   connect(button, &QPushButton::clicked, this, [this, i] { select(i); });
+  // Slots that call sender() and are connected at a single site of the TU
+  // are reported, as that site could hand the sender to a lambda.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    Sources = &Context.getSourceManager();
+
+    if (const CallExpr *Sender = Result.Nodes.getNodeAs<CallExpr>("sender")) {
+      SenderSlots.push_back(std::make_pair(Result.Nodes.getNodeAs<CXXMethodDecl>("slot"),
+                                           Sender->getLocStart()));
+      return;
+    }
+    if (const CallExpr *Connect = Result.Nodes.getNodeAs<CallExpr>("connect")) {
+      addSite(Connect);
+      return;
+    }
+
+    const VarDecl *Mapper = Result.Nodes.getNodeAs<VarDecl>("mapper");
+    std::string Reason = replaceMapper(Context, Mapper);
+    if (!Reason.empty())
+      reportOnce("signals", *Sources, Mapper->getLocation(),
+                 "QSignalMapper " + Mapper->getNameAsString() + " kept: " + Reason);
+  }
+
+  virtual void onStartOfTranslationUnit() {
+    SenderSlots.clear();
+    Sites.clear();
+  }
+
+  virtual void onEndOfTranslationUnit() {
+    for (const auto &Slot : SenderSlots) {
+      const CXXRecordDecl *Class = Slot.first->getParent();
+      std::vector<SourceLocation> Connected;
+      for (const Site &S : Sites) {
+        if (S.Name == Slot.first->getName() &&
+            (S.Class == Class || (S.Class->hasDefinition() && S.Class->isDerivedFrom(Class))))
+          Connected.push_back(S.Loc);
+      }
+      if (Connected.size() != 1)
+        continue;
+      SourceLocation Site = Sources->getSpellingLoc(Connected.front());
+      reportOnce("signals", *Sources, Slot.second,
+                 Slot.first->getQualifiedNameAsString() + "() uses sender() and is only connected at " +
+                 Sources->getFilename(Site).str() + ":" + std::to_string(Sources->getSpellingLineNumber(Site)) +
+                 ", which could pass the sender to a lambda");
+    }
+  }
+
+ private:
+  // A connection to the slot Name of Class, or of a class derived from it.
+  struct Site {
+    const CXXRecordDecl *Class;
+    std::string Name;
+    SourceLocation Loc;
+  };
+
+  // Returns the signature a SIGNAL() or SLOT() argument names, after the
+  // code the macro puts first: '1' for slots, '2' for signals.
+  static std::string connectSignature(const Expr *Arg) {
+    const Expr *E = Arg->IgnoreParenImpCasts();
+    // qFlagLocation("2" "clicked()" QLOCATION) in debug builds.
+    if (const CallExpr *Flag = dyn_cast<CallExpr>(E)) {
+      if (Flag->getNumArgs() == 1)
+        E = Flag->getArg(0)->IgnoreParenImpCasts();
+    }
+    const StringLiteral *Literal = dyn_cast<StringLiteral>(E);
+    if (!Literal || !Literal->isAscii())
+      return "";
+    StringRef Text = Literal->getString();
+    return Text.substr(0, Text.find('\0')).str();
+  }
+
+  // Returns "QString" for "const QString &" and "QWidget*" for "QWidget *".
+  static std::string normalizedType(StringRef Type) {
+    std::string Result;
+    for (char C : Type) {
+      if (C != ' ' && C != '&')
+        Result += C;
+    }
+    return StringRef(Result).startswith("const") ? Result.substr(5) : Result;
+  }
+
+  static const CXXRecordDecl *pointee(const Expr *E) {
+    return E->IgnoreParenImpCasts()->getType()->getPointeeCXXRecordDecl();
+  }
+
+  // Records a connection to a slot: SLOT(name(...)) with its receiver, or
+  // &Class::name.
+  void addSite(const CallExpr *Connect) {
+    for (unsigned I = 2; I < Connect->getNumArgs(); ++I) {
+      const Expr *Arg = Connect->getArg(I)->IgnoreParenImpCasts();
+      std::string Signature = connectSignature(Arg);
+      Site S;
+      S.Class = nullptr;
+      S.Loc = Connect->getLocStart();
+      if (!Signature.empty() && Signature[0] == '1') {
+        // connect(sender, SIGNAL(...), receiver, SLOT(...)), or
+        // receiver->connect(sender, SIGNAL(...), SLOT(...)).
+        const CXXMemberCallExpr *Member = dyn_cast<CXXMemberCallExpr>(Connect);
+        const Expr *Receiver = I == 3 ? Connect->getArg(2) : Member ? Member->getImplicitObjectArgument() : nullptr;
+        S.Class = Receiver ? pointee(Receiver) : nullptr;
+        S.Name = Signature.substr(1, Signature.find('(') - 1);
+      } else if (const UnaryOperator *Address = dyn_cast<UnaryOperator>(Arg)) {
+        const DeclRefExpr *Ref = dyn_cast<DeclRefExpr>(Address->getSubExpr());
+        const CXXMethodDecl *Method = Ref ? dyn_cast<CXXMethodDecl>(Ref->getDecl()) : nullptr;
+        if (Address->getOpcode() != UO_AddrOf || !Method)
+          continue;
+        S.Class = Method->getParent();
+        S.Name = Method->getName();
+      }
+      if (S.Class)
+        Sites.push_back(S);
+    }
+  }
+
+  // Returns the range that removes S, with its line if nothing else is on it.
+  static CharSourceRange statementRange(ASTContext &Context, const Stmt *S) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    SourceLocation Begin = S->getLocStart();
+    SourceLocation End = isa<DeclStmt>(S)
+        ? Lexer::getLocForEndOfToken(S->getLocEnd(), 0, SourceManager, Context.getLangOpts())
+        : Lexer::findLocationAfterToken(S->getLocEnd(), tok::semi, SourceManager, Context.getLangOpts(), false);
+    if (Begin.isMacroID() || End.isInvalid() || End.isMacroID())
+      return CharSourceRange();
+    return removalRange(SourceManager, Begin, End);
+  }
+
+  // Returns the signal Name of Class or a base, if it is not overloaded.
+  static const CXXMethodDecl *uniqueSignal(const CXXRecordDecl *Class, StringRef Name) {
+    Class = Class ? Class->getDefinition() : nullptr;
+    if (!Class)
+      return nullptr;
+    const CXXMethodDecl *Found = nullptr;
+    for (const NamedDecl *Candidate : Class->lookup(&Class->getASTContext().Idents.get(Name))) {
+      if (Found || !isa<CXXMethodDecl>(Candidate))
+        return nullptr;
+      Found = cast<CXXMethodDecl>(Candidate);
+    }
+    if (Found)
+      return Found;
+    for (const CXXBaseSpecifier &Base : Class->bases()) {
+      if (const CXXMethodDecl *Signal = uniqueSignal(Base.getType()->getAsCXXRecordDecl(), Name)) {
+        if (Found)
+          return nullptr;
+        Found = Signal;
+      }
+    }
+    return Found;
+  }
+
+  // Rewrites the connections made through Mapper, or returns why not.
+  std::string replaceMapper(ASTContext &Context, const VarDecl *Mapper) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    if (CreateIfdefs)
+      return "the lambdas need Qt 5, and -create-ifdefs is set";
+    if (!Context.getLangOpts().CPlusPlus11)
+      return "the lambdas need C++11";
+
+    std::vector<const Expr *> Uses;
+    if (!Mapper->getInit() || !isa<CXXNewExpr>(Mapper->getInit()->IgnoreImplicit()) ||
+        !localUses(Context, Mapper, Uses))
+      return "not created with new where it is declared";
+    ASTContext::DynTypedNodeList Parents = Context.getParents(*Mapper);
+    const DeclStmt *Declaration = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+    if (Declaration)
+      Parents = Context.getParents(*Declaration);
+    if (!Declaration || Parents.size() != 1 || !Parents[0].get<CompoundStmt>())
+      return "declared in a condition";
+
+    const CallExpr *Mapped = nullptr;
+    std::vector<const CallExpr *> Connects;
+    std::vector<const CXXMemberCallExpr *> Mappings;
+    for (const Expr *Use : Uses) {
+      const Stmt *Child;
+      const Stmt *User = user(Context, Use, Child);
+      const CallExpr *Call = dyn_cast_or_null<CallExpr>(User);
+      const FunctionDecl *Callee = Call ? Call->getDirectCallee() : nullptr;
+      if (const MemberExpr *Member = dyn_cast_or_null<MemberExpr>(User)) {
+        const CXXMemberCallExpr *Mapping = memberCall(Context, Member);
+        if (!Mapping || Member->getMemberDecl()->getName() != "setMapping")
+          return "calls " + Member->getMemberDecl()->getNameAsString() + "()";
+        Mappings.push_back(Mapping);
+      } else if (Callee && isa<CXXMethodDecl>(Callee) && Callee->getName() == "connect" &&
+                 cast<CXXMethodDecl>(Callee)->isStatic() && Call->getNumArgs() >= 4 &&
+                 (Call->getNumArgs() == 4 || isa<CXXDefaultArgExpr>(Call->getArg(4)))) {
+        if (Call->getArg(2)->IgnoreParenImpCasts() == Use && connectSignature(Call->getArg(3)) == "1map()")
+          Connects.push_back(Call);
+        else if (Call->getArg(0)->IgnoreParenImpCasts() == Use && !Mapped)
+          Mapped = Call;
+        else
+          return "connected in another way";
+      } else {
+        return "used in another way";
+      }
+    }
+
+    // connect(mapper, SIGNAL(mapped(T)), this, SLOT(slot(T)))
+    if (!Mapped || !isa<CXXThisExpr>(Mapped->getArg(2)->IgnoreParenImpCasts()))
+      return "mapped() is not connected to this";
+    std::string Signal = connectSignature(Mapped->getArg(1));
+    std::string Slot = connectSignature(Mapped->getArg(3));
+    size_t Open = Slot.find('(');
+    if (!StringRef(Signal).startswith("2mapped(") || Slot.empty() || Slot[0] != '1' ||
+        Open == std::string::npos || Open + 1 == Slot.size() || Slot.find(',') != std::string::npos)
+      return "mapped() is not connected to a slot";
+    std::string Type = normalizedType(StringRef(Signal).slice(8, Signal.find(')')));
+    bool SlotTakesValue = Slot[Open + 1] != ')';
+    std::string SlotName = Slot.substr(1, Open - 1);
+
+    const FunctionDecl *Connect = Mapped->getDirectCallee();
+    bool FunctorConnect = false;
+    for (const NamedDecl *Overload : cast<CXXMethodDecl>(Connect)->getParent()->lookup(Connect->getDeclName()))
+      FunctorConnect = FunctorConnect || isa<FunctionTemplateDecl>(Overload);
+    if (!FunctorConnect)
+      return "the lambdas need the Qt 5 headers";
+
+    std::vector<std::pair<SourceLocation, Replacement> > Edits;
+    std::vector<const CXXMemberCallExpr *> Paired;
+    for (const CallExpr *Call : Connects) {
+      // connect(sender, SIGNAL(signal(...)), mapper, SLOT(map())) next to
+      // mapper->setMapping(sender, value).
+      const CompoundStmt *Block;
+      const Stmt *Statement = blockStatement(Context, Call, Block);
+      if (!Statement)
+        return "connected in an expression";
+      std::string Sender = getText(SourceManager, *Call->getArg(0)->IgnoreParenImpCasts());
+      const Stmt *const *Position = std::find(Block->body_begin(), Block->body_end(), Statement);
+      const CXXMemberCallExpr *Mapping = nullptr;
+      const Stmt *MappingStatement = nullptr;
+      for (const CXXMemberCallExpr *Candidate : Mappings) {
+        const CompoundStmt *MappingBlock;
+        const Stmt *Other = blockStatement(Context, Candidate, MappingBlock);
+        if (Other && MappingBlock == Block && Candidate->getNumArgs() == 2 &&
+            ((Position != Block->body_begin() && Position[-1] == Other) ||
+             (Position + 1 != Block->body_end() && Position[1] == Other)) &&
+            getText(SourceManager, *Candidate->getArg(0)->IgnoreParenImpCasts()) == Sender) {
+          Mapping = Candidate;
+          MappingStatement = Other;
+        }
+      }
+      if (!Mapping || Sender.empty())
+        return "a connection has no setMapping() next to it";
+      Paired.push_back(Mapping);
+
+      const ParmVarDecl *Parameter = Mapping->getMethodDecl()->getParamDecl(1);
+      QualType MappedType = Parameter->getType().getNonReferenceType().getUnqualifiedType();
+      if (normalizedType(MappedType.getAsString(Context.getPrintingPolicy())) != Type)
+        return "a setMapping() does not match mapped(" + Type + ")";
+
+      // The value is copied into the lambda when it is connected, as
+      // setMapping() copied it.
+      const Expr *Value = Mapping->getArg(1)->IgnoreParenImpCasts();
+      std::string ValueText = getText(SourceManager, *Value);
+      std::string Capture = "[this";
+      if (const DeclRefExpr *Ref = dyn_cast<DeclRefExpr>(Value)) {
+        const VarDecl *Var = dyn_cast<VarDecl>(Ref->getDecl());
+        if (!Var || !Var->hasLocalStorage())
+          return "a mapped value is not a local variable or a literal";
+        Capture += ", " + Var->getNameAsString();
+      } else if (!isa<IntegerLiteral>(Value) && !isa<StringLiteral>(Value)) {
+        return "a mapped value is not a local variable or a literal";
+      }
+      Capture += "]";
+
+      std::string Name = connectSignature(Call->getArg(1));
+      Name = Name.substr(1, Name.find('(') - 1);
+      const CXXRecordDecl *SenderClass = pointee(Call->getArg(0));
+      if (!SenderClass || !uniqueSignal(SenderClass, Name))
+        return "the signal " + Name + " is overloaded or unknown";
+
+      SourceRange Range = Call->getSourceRange();
+      CharSourceRange Removed = statementRange(Context, MappingStatement);
+      if (Range.getBegin().isMacroID() || Range.getEnd().isMacroID() || Removed.isInvalid())
+        return "in a macro";
+      std::string Lambda = Capture + " { " + SlotName + "(" + (SlotTakesValue ? ValueText : "") + "); }";
+      Edits.push_back(std::make_pair(Range.getBegin(), Replacement(SourceManager,
+          CharSourceRange::getTokenRange(Range),
+          getText(SourceManager, *Call->getCallee()) + "(" + Sender + ", &" +
+          SenderClass->getQualifiedNameAsString() + "::" + Name + ", this, " + Lambda + ")")));
+      Edits.push_back(std::make_pair(Removed.getBegin(), Replacement(SourceManager, Removed, "")));
+    }
+    if (Paired.size() != Mappings.size())
+      return "a setMapping() has no connection next to it";
+
+    const CompoundStmt *Block;
+    const Stmt *MappedStatement = blockStatement(Context, Mapped, Block);
+    CharSourceRange MappedRange = MappedStatement ? statementRange(Context, MappedStatement) : CharSourceRange();
+    CharSourceRange DeclarationRange = statementRange(Context, Declaration);
+    if (MappedRange.isInvalid() || DeclarationRange.isInvalid())
+      return "in a macro";
+    Edits.push_back(std::make_pair(MappedRange.getBegin(), Replacement(SourceManager, MappedRange, "")));
+    Edits.push_back(std::make_pair(DeclarationRange.getBegin(), Replacement(SourceManager, DeclarationRange, "")));
+
+    for (const auto &Edit : Edits) {
+      Utils::AddReplacement(
+        SourceManager.getFileEntryForID(SourceManager.getFileID(Edit.first)),
+        Edit.second,
+        Replace
+      );
+    }
+    return "";
+  }
+
+  std::map<std::string, Replacements> *Replace;
+  const SourceManager *Sources;
+  std::vector<std::pair<const CXXMethodDecl *, SourceLocation> > SenderSlots;
+  std::vector<Site> Sites;
+};
+
+class PortSharedCreate : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortSharedCreate(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // QSharedPointer<T>(new T(a, b)) and p.reset(new T(a, b)) become
+  // QSharedPointer<T>::create(a, b) and p = QSharedPointer<T>::create(a, b),
+  // which allocate the object and the reference count at once. The same
+  // goes for std::shared_ptr and std::make_shared. A pointer to a base of
+  // T only gets its argument replaced.
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    SourceManager &srcMgr = Context.getSourceManager();
+    const CXXNewExpr *New = Result.Nodes.getNodeAs<CXXNewExpr>("new");
+    const CXXConstructExpr *Construct = Result.Nodes.getNodeAs<CXXConstructExpr>("construct");
+    const CXXMemberCallExpr *Reset = Result.Nodes.getNodeAs<CXXMemberCallExpr>("reset");
+
+    const ClassTemplateSpecializationDecl *Pointer = dyn_cast<ClassTemplateSpecializationDecl>(
+        Construct ? Construct->getConstructor()->getParent() : Reset->getMethodDecl()->getParent());
+    std::string Creator;
+    if (!Pointer || Pointer->getTemplateArgs().size() < 1 || !creator(Context, New, Pointer, Creator))
+      return;
+    bool Qt = Pointer->getName() == "QSharedPointer";
+    bool Whole = Context.hasSameType(New->getAllocatedType(), Pointer->getTemplateArgs()[0].getAsType());
+
+    const Expr *Replaced = New;
+    std::string Text = Creator;
+    if (Reset) {
+      const MemberExpr *Callee = cast<MemberExpr>(Reset->getCallee());
+      std::string Object = getText(srcMgr, *Reset->getImplicitObjectArgument());
+      if (Callee->isArrow() || Object.empty())
+        return;
+      Replaced = Reset;
+      Text = Object + " = " + Creator;
+    } else if (Whole) {
+      // QSharedPointer<T>(new T) as a whole.
+      ASTContext::DynTypedNodeList Parents = Context.getParents(*Construct);
+      while (Parents.size() == 1 && Parents[0].get<CXXBindTemporaryExpr>())
+        Parents = Context.getParents(*Parents[0].get<CXXBindTemporaryExpr>());
+      if (Parents.size() == 1 && Parents[0].get<CXXFunctionalCastExpr>())
+        Replaced = Parents[0].get<CXXFunctionalCastExpr>();
+    }
+    if (Replaced->getLocStart().isMacroID() || Replaced->getLocEnd().isMacroID())
+      return;
+
+    Utils::AddReplacement(
+      srcMgr.getFileEntryForID(srcMgr.getFileID(Replaced->getLocStart())),
+      Replacement(srcMgr, Replaced, Text),
+      Replace
+    );
+
+    // QSharedPointer::create() takes arguments since Qt 5.1,
+    // std::make_shared() comes with std::shared_ptr.
+    if (Qt && CreateIfdefs)
+      insertIfdef(Result.SourceManager, Replaced, Replace, "5, 1, 0");
+  }
+
+ private:
+  // Sets Creator to the call that makes what New does, if it can: the
+  // arguments must be passed on unchanged, and T must not have its own
+  // operator new or a constructor the factory cannot call.
+  static bool creator(ASTContext &Context, const CXXNewExpr *New,
+                      const ClassTemplateSpecializationDecl *Pointer, std::string &Creator) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    if (New->isArray() || New->getNumPlacementArgs() ||
+        New->getInitializationStyle() == CXXNewExpr::ListInit ||
+        (New->getOperatorNew() && isa<CXXMethodDecl>(New->getOperatorNew())) ||
+        New->getLocStart().isMacroID() || New->getLocEnd().isMacroID())
+      return false;
+    bool Qt = Pointer->getName() == "QSharedPointer";
+    if (Qt && !CreateIfdefs && Pointer->lookup(&Context.Idents.get("create")).empty())
+      return false;
+
+    std::vector<const Expr *> Arguments;
+    if (const CXXConstructExpr *Construct = New->getConstructExpr()) {
+      if (Construct->getConstructor()->getAccess() == AS_private ||
+          Construct->getConstructor()->getAccess() == AS_protected)
+        return false;
+      Arguments.assign(Construct->arg_begin(), Construct->arg_end());
+    } else if (const ParenListExpr *List = dyn_cast_or_null<ParenListExpr>(New->getInitializer())) {
+      Arguments.assign(List->exprs(), List->exprs() + List->getNumExprs());
+    } else if (New->getInitializer()) {
+      Arguments.push_back(New->getInitializer());
+    }
+    for (const Expr *Argument : Arguments) {
+      // Braced lists, 0 as a null pointer and bit-fields cannot be
+      // forwarded.
+      const ImplicitCastExpr *Cast = dyn_cast<ImplicitCastExpr>(Argument);
+      if (isa<CXXDefaultArgExpr>(Argument))
+        continue;
+      if (isa<InitListExpr>(Argument->IgnoreImplicit()) ||
+          (Cast && Cast->getCastKind() == CK_NullToPointer &&
+           !isa<CXXNullPtrLiteralExpr>(Cast->getSubExpr()->IgnoreParens())) ||
+          Argument->IgnoreImpCasts()->refersToBitField())
+        return false;
+    }
+
+    std::string Type = Lexer::getSourceText(
+        CharSourceRange::getTokenRange(New->getAllocatedTypeSourceInfo()->getTypeLoc().getSourceRange()),
+        SourceManager, Context.getLangOpts()).str();
+    std::string Args;
+    SourceRange Parens = New->getDirectInitRange();
+    if (Parens.isValid()) {
+      Args = Lexer::getSourceText(
+          CharSourceRange::getCharRange(Parens.getBegin().getLocWithOffset(1), Parens.getEnd()),
+          SourceManager, Context.getLangOpts()).str();
+    }
+    if (Type.empty())
+      return false;
+    Creator = Qt ? "QSharedPointer<" + Type + ">::create(" + Args + ")"
+                 : "std::make_shared<" + Type + ">(" + Args + ")";
+    return true;
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+
+class PortMetaType : public ast_matchers::MatchFinder::MatchCallback {
+ public:
+  PortMetaType(std::map<std::string, Replacements> *Replace)
+      : Replace(Replace) {}
+
+  // Avoids the locked look-ups of types by name:
+  //   QMetaType::type("Foo")            qMetaTypeId<Foo>()
+  //   qRegisterMetaType<Foo>("Foo");    static const int FooMetaTypeId = qRegisterMetaType<Foo>("Foo");
+  //                                     Q_UNUSED(FooMetaTypeId)
+  //   Q_ENUMS(Mode)                     Q_ENUM(Mode) after the enum
+  virtual void run(const ast_matchers::MatchFinder::MatchResult &Result) {
+    ASTContext &Context = *Result.Context;
+    if (const CallExpr *Lookup = Result.Nodes.getNodeAs<CallExpr>("lookup"))
+      portLookup(Context, Lookup, Result.Nodes.getNodeAs<StringLiteral>("name"));
+    if (const CallExpr *Register = Result.Nodes.getNodeAs<CallExpr>("register"))
+      portRegister(Context, Register);
+    if (const CXXRecordDecl *Class = Result.Nodes.getNodeAs<CXXRecordDecl>("class"))
+      portEnums(Context, Class);
+  }
+
+ private:
+  void add(const SourceManager &SourceManager, SourceLocation Loc, const Replacement &Edit) {
+    Utils::AddReplacement(SourceManager.getFileEntryForID(SourceManager.getFileID(Loc)), Edit, Replace);
+  }
+
+  // Returns the built-in type Name spells, if it is one.
+  static QualType builtinNamed(ASTContext &Context, StringRef Name) {
+    static const struct {
+      const char *Name;
+      CanQualType ASTContext::*Type;
+    } Builtins[] = {
+      { "bool", &ASTContext::BoolTy },
+      { "char", &ASTContext::CharTy },
+      { "signed char", &ASTContext::SignedCharTy },
+      { "unsigned char", &ASTContext::UnsignedCharTy },
+      { "short", &ASTContext::ShortTy },
+      { "unsigned short", &ASTContext::UnsignedShortTy },
+      { "int", &ASTContext::IntTy },
+      { "unsigned int", &ASTContext::UnsignedIntTy },
+      { "long", &ASTContext::LongTy },
+      { "unsigned long", &ASTContext::UnsignedLongTy },
+      { "long long", &ASTContext::LongLongTy },
+      { "unsigned long long", &ASTContext::UnsignedLongLongTy },
+      { "float", &ASTContext::FloatTy },
+      { "double", &ASTContext::DoubleTy }
+    };
+    for (const auto &Builtin : Builtins) {
+      if (Name == Builtin.Name)
+        return Context.*Builtin.Type;
+    }
+    return QualType();
+  }
+
+  // Returns the type Name is declared as in the TU before Loc, if any.
+  static const TypeDecl *typeNamed(ASTContext &Context, StringRef Name, SourceLocation Loc) {
+    const DeclContext *Scope = Context.getTranslationUnitDecl();
+    if (Name.startswith("::"))
+      Name = Name.drop_front(2);
+    for (;;) {
+      std::pair<StringRef, StringRef> Parts = Name.split("::");
+      const NamedDecl *Found = nullptr;
+      for (const NamedDecl *Candidate : Scope->lookup(&Context.Idents.get(Parts.first))) {
+        if (isa<NamespaceDecl>(Candidate) || isa<TypeDecl>(Candidate))
+          Found = Candidate;
+      }
+      if (!Found || !Context.getSourceManager().isBeforeInTranslationUnit(Found->getLocation(), Loc))
+        return nullptr;
+      if (Parts.second.empty())
+        return dyn_cast<TypeDecl>(Found);
+      Scope = dyn_cast<DeclContext>(Found);
+      if (!Scope)
+        return nullptr;
+      Name = Parts.second;
+    }
+  }
+
+  // Returns true if Q_DECLARE_METATYPE, or Qt itself for the built-in
+  // types, declared Type before Loc, so that qMetaTypeId<Type>() compiles.
+  static bool declaredMetaType(ASTContext &Context, QualType Type, SourceLocation Loc) {
+    static const char *const Templates[] = { "QMetaTypeId", "QMetaTypeId2" };
+    for (const char *Name : Templates) {
+      for (const NamedDecl *Candidate : Context.getTranslationUnitDecl()->lookup(&Context.Idents.get(Name))) {
+        const ClassTemplateDecl *Template = dyn_cast<ClassTemplateDecl>(Candidate);
+        if (!Template)
+          continue;
+        for (const ClassTemplateSpecializationDecl *Specialization : Template->specializations()) {
+          if (Specialization->getSpecializationKind() == TSK_ExplicitSpecialization &&
+              Specialization->getTemplateArgs().size() == 1 &&
+              Specialization->getTemplateArgs()[0].getKind() == TemplateArgument::Type &&
+              Context.hasSameType(Specialization->getTemplateArgs()[0].getAsType(), Type) &&
+              Context.getSourceManager().isBeforeInTranslationUnit(Specialization->getLocation(), Loc))
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // QMetaType::type("Foo") becomes qMetaTypeId<Foo>(), which finds the id
+  // once and keeps it, when Foo names a declared meta type.
+  void portLookup(ASTContext &Context, const CallExpr *Lookup, const StringLiteral *Name) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    SourceLocation Loc = Lookup->getLocStart();
+    if (!Name->isAscii())
+      return;
+    QualType Type = builtinNamed(Context, Name->getString());
+    std::string Spelling = Name->getString().str();
+    if (Type.isNull()) {
+      if (const TypeDecl *Declared = typeNamed(Context, Name->getString(), Loc)) {
+        Type = Context.getTypeDeclType(Declared);
+        Spelling = Declared->getQualifiedNameAsString();
+      }
+    }
+    if (Type.isNull() || !declaredMetaType(Context, Type, Loc)) {
+      reportOnce("metatypes", SourceManager, Loc,
+                 "QMetaType::type(\"" + Name->getString().str() + "\") kept: not a declared meta type");
+      return;
+    }
+    if (Loc.isMacroID() || Lookup->getLocEnd().isMacroID())
+      return;
+    add(SourceManager, Loc, Replacement(SourceManager, Lookup, "qMetaTypeId<" + Spelling + ">()"));
+  }
+
+  // qRegisterMetaType<Foo>("Foo"); normalizes and looks up the name each
+  // time; as the initializer of a static local it only runs once.
+  void portRegister(ASTContext &Context, const CallExpr *Register) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    const CompoundStmt *Block;
+    if (blockStatement(Context, Register, Block) != Register)
+      return;
+    std::string Variable = idVariable(Register);
+    // Another static of that name in the block, or one the rewrite of an
+    // earlier registration there declares, keeps this registration.
+    for (const Stmt *Statement : Block->body()) {
+      if (Statement == Register)
+        break;
+      const CallExpr *Earlier = dyn_cast<CallExpr>(Statement);
+      if (Earlier && Earlier->getDirectCallee() && Earlier->getNumArgs() > 0 &&
+          Earlier->getDirectCallee()->getName() == "qRegisterMetaType" &&
+          isa<StringLiteral>(Earlier->getArg(0)->IgnoreParenImpCasts()) &&
+          idVariable(Earlier) == Variable)
+        return;
+    }
+    for (const Stmt *Statement : Block->body()) {
+      const DeclStmt *Declaration = dyn_cast<DeclStmt>(Statement);
+      if (!Declaration)
+        continue;
+      for (const Decl *D : Declaration->decls()) {
+        const NamedDecl *Named = dyn_cast<NamedDecl>(D);
+        if (Named && Named->getName() == Variable)
+          return;
+      }
+    }
+
+    std::string Indent;
+    SourceLocation Begin = Register->getLocStart();
+    SourceLocation End = Lexer::findLocationAfterToken(Register->getLocEnd(), tok::semi, SourceManager,
+                                                       Context.getLangOpts(), false);
+    if (Begin.isMacroID() || End.isInvalid() || End.isMacroID() ||
+        !indentation(SourceManager, Begin, Indent))
+      return;
+    add(SourceManager, Begin, Replacement(SourceManager, CharSourceRange::getCharRange(Begin, End),
+        "static const int " + Variable + " = " + getText(SourceManager, *Register) + ";\n" +
+        Indent + "Q_UNUSED(" + Variable + ")"));
+  }
+
+  // Returns the name of the static that keeps the id Register returns:
+  // FooPtrMetaTypeId for qRegisterMetaType<Foo *>("Foo*").
+  static std::string idVariable(const CallExpr *Register) {
+    const StringLiteral *Name = cast<StringLiteral>(Register->getArg(0)->IgnoreParenImpCasts());
+    std::string Variable;
+    for (char C : Name->getBytes()) {
+      if (isalnum(static_cast<unsigned char>(C)) || C == '_')
+        Variable += C;
+      else if (C == '*')
+        Variable += "Ptr";
+      else if (C == '&')
+        Variable += "Ref";
+      else if (C == ':' || C == '<' || C == ',')
+        Variable += '_';
+    }
+    if (Variable.empty() || isdigit(static_cast<unsigned char>(Variable[0])))
+      Variable = "_" + Variable;
+    return Variable + "MetaTypeId";
+  }
+
+  // Q_ENUMS(A B) in a class with Q_OBJECT or Q_GADGET becomes Q_ENUM(A) and
+  // Q_ENUM(B) right after the enums, which also registers them as meta
+  // types. Q_ENUMS expands to nothing, so its tokens are found by lexing the
+  // class.
+  void portEnums(ASTContext &Context, const CXXRecordDecl *Class) {
+    const SourceManager &SourceManager = Context.getSourceManager();
+    const LangOptions &LangOpts = Context.getLangOpts();
+    SourceRange Braces = Class->getBraceRange();
+    if (Braces.isInvalid() || Braces.getBegin().isMacroID() || Braces.getEnd().isMacroID() ||
+        Class->lookup(&Context.Idents.get("staticMetaObject")).empty())
+      return;
+
+    FileID File = SourceManager.getFileID(Braces.getBegin());
+    StringRef Buffer = SourceManager.getBufferData(File);
+    unsigned First = SourceManager.getFileOffset(Braces.getBegin());
+    unsigned Last = SourceManager.getFileOffset(Braces.getEnd());
+    Lexer Raw(SourceManager.getLocForStartOfFile(File), LangOpts,
+              Buffer.begin(), Buffer.begin() + First, Buffer.end());
+    Token Tok;
+    while (!Raw.LexFromRawLexer(Tok) && SourceManager.getFileOffset(Tok.getLocation()) < Last) {
+      if (!Tok.is(tok::raw_identifier) || Tok.getRawIdentifier() != "Q_ENUMS" ||
+          nested(SourceManager, Class, Tok.getLocation()))
+        continue;
+      SourceLocation Begin = Tok.getLocation();
+      std::vector<std::string> Names;
+      Raw.LexFromRawLexer(Tok);
+      bool Valid = Tok.is(tok::l_paren);
+      while (Valid && !Raw.LexFromRawLexer(Tok) && !Tok.is(tok::r_paren)) {
+        if (Tok.is(tok::raw_identifier))
+          Names.push_back(Tok.getRawIdentifier().str());
+        else
+          Valid = Tok.is(tok::comma);
+      }
+      if (!Valid || !Tok.is(tok::r_paren) || Names.empty())
+        continue;
+      SourceLocation End = Tok.getEndLoc();
+      std::string Reason = enumsKept(Context, Class, Names);
+      if (!Reason.empty()) {
+        reportOnce("metatypes", SourceManager, Begin, "Q_ENUMS kept: " + Reason);
+        continue;
+      }
+
+      std::vector<std::pair<SourceLocation, Replacement> > Edits;
+      CharSourceRange Removed = removalRange(SourceManager, Begin, End);
+      Edits.push_back(std::make_pair(Removed.getBegin(), Replacement(SourceManager, Removed, "")));
+      for (const std::string &Name : Names) {
+        const EnumDecl *Enum = memberEnum(Context, Class, Name);
+        std::string Indent;
+        SourceLocation After = Lexer::findLocationAfterToken(Enum->getLocEnd(), tok::semi, SourceManager,
+                                                             LangOpts, false);
+        if (Enum->getLocStart().isMacroID() || After.isInvalid() || After.isMacroID() ||
+            !indentation(SourceManager, Enum->getLocStart(), Indent)) {
+          Edits.clear();
+          break;
+        }
+        Edits.push_back(std::make_pair(After, Replacement(SourceManager, After, 0,
+                                                          "\n" + Indent + "Q_ENUM(" + Name + ")")));
+      }
+      for (const auto &Edit : Edits)
+        add(SourceManager, Edit.first, Edit.second);
+    }
+  }
+
+  // Returns true if Loc is inside a class nested in Class.
+  static bool nested(const SourceManager &SourceManager, const CXXRecordDecl *Class, SourceLocation Loc) {
+    for (const Decl *Member : Class->decls()) {
+      const CXXRecordDecl *Inner = dyn_cast<CXXRecordDecl>(Member);
+      if (Inner && !Inner->isImplicit() && Inner->isThisDeclarationADefinition() &&
+          !SourceManager.isBeforeInTranslationUnit(Loc, Inner->getBraceRange().getBegin()) &&
+          SourceManager.isBeforeInTranslationUnit(Loc, Inner->getBraceRange().getEnd()))
+        return true;
+    }
+    return false;
+  }
+
+  static const EnumDecl *memberEnum(ASTContext &Context, const CXXRecordDecl *Class, StringRef Name) {
+    for (const NamedDecl *Candidate : Class->lookup(&Context.Idents.get(Name))) {
+      const EnumDecl *Enum = dyn_cast<EnumDecl>(Candidate);
+      if (Enum && Enum->isThisDeclarationADefinition())
+        return Enum;
+    }
+    return nullptr;
+  }
+
+  // Returns why Q_ENUMS(Names) of Class stays, or nothing.
+  static std::string enumsKept(ASTContext &Context, const CXXRecordDecl *Class,
+                               const std::vector<std::string> &Names) {
+    if (CreateIfdefs)
+      return "Q_ENUM needs Qt 5.5, and -create-ifdefs is set";
+    // Matching runs once the TU is parsed, so this is what
+    // Preprocessor::isMacroDefined would say at its end.
+    if (!Context.Idents.get("Q_ENUM").hasMacroDefinition())
+      return "Q_ENUM needs Qt 5.5, and the headers do not define it";
+    for (const std::string &Name : Names) {
+      if (!memberEnum(Context, Class, Name))
+        return Name + " is not an enum defined in " + Class->getNameAsString();
+    }
+    return "";
+  }
+
+  std::map<std::string, Replacements> *Replace;
+};
+} // end namespace
+
+void addRenameMethod(PortRegistry &Ports)
+{
+  std::string matchName = RenameMethod_Class.size() ? RenameMethod_Class : std::string();
+  matchName += "::" + Rename_Old;
+
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "rename-method", "PortRenamedMethods", new PortRenamedMethods(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      callExpr(
+        anyOf(
+          allOf(
+            callee(functionDecl(hasName(matchName))),
+            callee(memberExpr().bind("exact"))
+          ),
+          allOf(
+            callee(functionDecl(hasName(Rename_Old))),
+            callee(memberExpr().bind("expr"))
+          ),
+          allOf(
+            callee(functionDecl(hasName(matchName))),
+            callee(expr().bind("func"))
+          )
+        )
+      ).bind("call"), 
+      Rule);
+}
+
+void addQMetaMethodSignature(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qmetamethod-signature", "PortMetaMethods", new PortMetaMethods(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+    	stmt(
+      	stmt(
+          has(
+            callExpr(
+              callee(
+                memberExpr()
+              )
+            ).bind("call")
+          ),
+          has(callExpr(callee(functionDecl(hasName("::QMetaMethod::signature")))))
+        ),
+        expr(unless(clang::ast_matchers::binaryOperator()))
+      )
+    , Rule);
+}
+
+void addQtEscape(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qt-escape", "PortQtEscape4To5", new PortQtEscape4To5(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+    callExpr(
+      callee(functionDecl(hasName(QtEscapeFunction))),
+      hasArgument(
+        0,
+        anyOf(
+          cxxBindTemporaryExpr(has(cxxOperatorCallExpr().bind("operator"))),//unclear wheather or not this is needed still
+          cxxOperatorCallExpr().bind("operator"),
+          cxxConstructExpr().bind("ctor"),
+          expr().bind("expr")
+        )
+      )
+    ).bind("call"),
+    Rule);
+}
+
+void addAtomics(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-atomics", "PortAtomic", new PortAtomic(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(functionDecl(hasName("::QBasicAtomicInt::operator int")))
+      ).bind("call"), Rule);
+}
+
+void addQImageText(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qimage-text", "RemoveArgument", new RemoveArgument(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(functionDecl(hasName("::QImage::text"))),
+        hasArgument(
+          0,
+          expr().bind("prevArg")
+        ),
+        hasArgument(
+          1,
+          expr(clang::ast_matchers::integerLiteral(equals(0)).bind("arg"))
+        )
+      ).bind("call"), Rule);
+
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(functionDecl(hasName("::QImage::setText"))),
+        hasArgument(
+          0,
+          expr().bind("prevArg")
+        ),
+        hasArgument(
+          1,
+          expr(clang::ast_matchers::integerLiteral(equals(0)).bind("arg"))
+        )
+      ).bind("call"), Rule);
+}
+
+void addViewDataChanged(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qabstractitemview-datachanged", "PortView2", new PortView2(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      cxxMethodDecl(
+        hasName("dataChanged"),
+        ofClass(
+          allOf(
+            isDerivedFrom("QAbstractItemView"),
+            unless(hasName("QAbstractItemView"))
+          )
+        )
+      ).bind("funcDecl"), Rule);
+}
+
+void addQStringArg(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qstring-arg", "CollapseArgChain", new CollapseArgChain(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      cxxMemberCallExpr(
+        callee(cxxMethodDecl(hasName("::QString::arg")))
+      ).bind("call"), Rule);
+}
+
+void addQStringRef(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qstringref", "PortStringRefs", new PortStringRefs(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      cxxMemberCallExpr(
+        callee(
+          cxxMethodDecl(
+            anyOf(hasName("::QString::mid"), hasName("::QString::left"), hasName("::QString::right"))
+          )
+        )
+      ).bind("call"), Rule);
+
+  Ports.finder().addMatcher(cxxForRangeStmt().bind("loop"), Rule);
+}
+
+void addReserve(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-reserve", "InsertReserve", new InsertReserve(Ports.replacements()));
+
+  Ports.finder().addMatcher(forStmt().bind("loop"), Rule);
+}
+
+void addQHash(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qhash", "PortMapToHash", new PortMapToHash(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      varDecl(hasType(classTemplateSpecializationDecl(hasName("::QMap")))).bind("var"), Rule);
+  Ports.finder().addMatcher(
+      fieldDecl(hasType(classTemplateSpecializationDecl(hasName("::QMap")))).bind("field"), Rule);
+}
+
+void addSequences(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-sequences", "PortSequence", new PortSequence(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      varDecl(
+        hasType(classTemplateSpecializationDecl(anyOf(hasName("::QLinkedList"), hasName("::QList"))))
+      ).bind("var"), Rule);
+  Ports.finder().addMatcher(
+      fieldDecl(
+        hasType(classTemplateSpecializationDecl(anyOf(hasName("::QLinkedList"), hasName("::QList"))))
+      ).bind("field"), Rule);
+}
+
+namespace clang {
+namespace ast_matchers {
+const internal::VariadicDynCastAllOfMatcher<clang::Decl, clang::EnumConstantDecl> enumeratorConstant;
+const internal::VariadicDynCastAllOfMatcher<clang::Stmt, clang::CXXTypeidExpr> cxxTypeidExpr;
+}
+}
+
+void addRenameEnum(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "rename-enum", "PortEnum", new PortEnum(Ports.replacements()));
+
+  Ports.finder().addMatcher(
     declRefExpr(to(enumeratorConstant(hasName(RenameEnum + "::" + Rename_Old)))).bind("call"),
-    &Callback);
+    Rule);
+}
 
-  return Tool.run(newFrontendActionFactory(&Finder).get());
+void addQObjectCast(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-qobject-cast", "PortDynamicCast", new PortDynamicCast(Ports.replacements()));
+
+  // Instantiations are the casts of their template.
+  Ports.finder().addMatcher(
+      cxxDynamicCastExpr(
+        unless(isExpansionInSystemHeader()),
+        unless(isInTemplateInstantiation())
+      ).bind("cast"), Rule);
+  Ports.finder().addMatcher(
+      cxxTypeidExpr(
+        unless(isExpansionInSystemHeader()),
+        unless(isInTemplateInstantiation())
+      ).bind("typeid"), Rule);
 }
 
-int main(int argc, char **argv) {
-  cl::ParseCommandLineOptions(argc, argv);
-  std::string ErrorMessage;
-  std::unique_ptr<CompilationDatabase> Compilations(
-    CompilationDatabase::loadFromDirectory(BuildPath, ErrorMessage));
+void addElapsedTimer(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-elapsed-timer", "PortTimer", new PortTimer(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      varDecl(hasType(cxxRecordDecl(hasName("::QTime")))).bind("time"), Rule);
+  Ports.finder().addMatcher(
+      varDecl(hasType(cxxRecordDecl(hasName("::QDateTime")))).bind("datetime"), Rule);
+  Ports.finder().addMatcher(
+      cxxMemberCallExpr(
+        callee(cxxMethodDecl(hasName("::QDateTime::toMSecsSinceEpoch")))
+      ).bind("epoch"), Rule);
+}
 
+void addSignalMapper(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-signal-mapper", "PortSignalMapper", new PortSignalMapper(Ports.replacements()));
+
+  Ports.finder().addMatcher(
+      varDecl(
+        hasType(pointerType(pointee(cxxRecordDecl(hasName("::QSignalMapper")))))
+      ).bind("mapper"), Rule);
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(cxxMethodDecl(hasName("::QObject::sender"))),
+        unless(isExpansionInSystemHeader()),
+        hasAncestor(cxxMethodDecl().bind("slot"))
+      ).bind("sender"), Rule);
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(functionDecl(hasName("::QObject::connect"))),
+        unless(isExpansionInSystemHeader())
+      ).bind("connect"), Rule);
+}
 
-  if (!Compilations)
-    llvm::report_fatal_error(ErrorMessage);
+void addMakeShared(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-make-shared", "PortSharedCreate", new PortSharedCreate(Ports.replacements()));
+
+  // A second argument is a deleter, which create() cannot take.
+  Ports.finder().addMatcher(
+      cxxConstructExpr(
+        hasDeclaration(cxxConstructorDecl(ofClass(anyOf(hasName("::QSharedPointer"), hasName("::std::shared_ptr"))))),
+        argumentCountIs(1),
+        hasArgument(0, ignoringImplicit(cxxNewExpr().bind("new"))),
+        unless(isInTemplateInstantiation())
+      ).bind("construct"), Rule);
+  Ports.finder().addMatcher(
+      cxxMemberCallExpr(
+        callee(cxxMethodDecl(hasName("reset"), ofClass(anyOf(hasName("::QSharedPointer"), hasName("::std::shared_ptr"))))),
+        argumentCountIs(1),
+        hasArgument(0, ignoringImplicit(cxxNewExpr().bind("new"))),
+        unless(isInTemplateInstantiation())
+      ).bind("reset"), Rule);
+}
 
-  if (RenameEnum != std::string())
-    return portEnum(*Compilations);
+void addMetaTypes(PortRegistry &Ports)
+{
+  MatchFinder::MatchCallback *Rule = Ports.addRule(
+    "port-metatypes", "PortMetaType", new PortMetaType(Ports.replacements()));
 
-  if (Rename_Old != std::string() && Rename_New != std::string())
-    return portMethod(*Compilations);
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(cxxMethodDecl(hasName("::QMetaType::type"))),
+        argumentCountIs(1),
+        hasArgument(0, ignoringParenImpCasts(stringLiteral().bind("name"))),
+        unless(isExpansionInSystemHeader()),
+        unless(isInTemplateInstantiation())
+      ).bind("lookup"), Rule);
+  Ports.finder().addMatcher(
+      callExpr(
+        callee(functionDecl(hasName("::qRegisterMetaType"))),
+        hasArgument(0, ignoringParenImpCasts(stringLiteral())),
+        unless(isExpansionInSystemHeader()),
+        unless(isInTemplateInstantiation())
+      ).bind("register"), Rule);
+  Ports.finder().addMatcher(
+      cxxRecordDecl(
+        isDefinition(),
+        unless(isExpansionInSystemHeader()),
+        unless(isInstantiated())
+      ).bind("class"), Rule);
+}
+
+// Adds every selected rule to one MatchFinder and runs them in a single pass.
+int portSelected(const CompilationDatabase &Compilations) {
+  tooling::RefactoringTool Tool(Compilations, sourceFiles());
+  PortRegistry Ports(&Tool.getReplacements());
+
+  if (RenameEnum != std::string())
+    addRenameEnum(Ports);
+  else if (Rename_Old != std::string() && Rename_New != std::string())
+    addRenameMethod(Ports);
 
   if (PortQMetaMethodSignature)
-    return portQMetaMethodSignature(*Compilations);
+    addQMetaMethodSignature(Ports);
 
   if (PortQtEscape)
-    return portQtEscape(*Compilations);
+    addQtEscape(Ports);
 
   if (PortAtomics)
-    return portAtomics(*Compilations);
+    addAtomics(Ports);
 
   if(Port_QImage_text)
-    return portQImageText(*Compilations);
+    addQImageText(Ports);
 
   if (Port_QAbstractItemView_dataChanged)
-    return portViewDataChanged(*Compilations);
+    addViewDataChanged(Ports);
+
+  if (PortQStringArg)
+    addQStringArg(Ports);
+
+  if (PortQStringRef)
+    addQStringRef(Ports);
+
+  if (PortReserve)
+    addReserve(Ports);
+
+  if (PortQHash)
+    addQHash(Ports);
+
+  if (PortSequences)
+    addSequences(Ports);
+
+  if (PortQObjectCast)
+    addQObjectCast(Ports);
+
+  if (PortElapsedTimer)
+    addElapsedTimer(Ports);
+
+  if (PortSignalMappers)
+    addSignalMapper(Ports);
+
+  if (PortMakeShared)
+    addMakeShared(Ports);
+
+  if (PortMetaTypes)
+    addMetaTypes(Ports);
+
+  for (const std::string &File : RuleFiles) {
+    if (!addRuleFile(File, Ports, CreateIfdefs, llvm::errs()))
+      return 1;
+  }
+
+  for (const std::string &File : Plugins) {
+    if (!loadPlugin(File, Ports, CreateIfdefs, llvm::errs()))
+      return 1;
+  }
+
+  if (Ports.rules().empty())
+    return 1; // No useful arguments.
+
+  if (!ResultsFile.empty() && !Results::open(ResultsFile, ResultsFormat, Ports.rules()))
+    return 1;
+  // Unity batches and workers do not finish the TUs by name, so their
+  // files are all diffed at the end.
+  std::unique_ptr<IncludeGraph> Graph;
+  if (Diff::enabled() && !Unity && !(TUTimeout || TUMemoryLimit)) {
+    Graph.reset(new IncludeGraph(Compilations, sourceFiles(), jobCount()));
+    Diff::stream(*Graph, sourceFiles(), Ports.rules());
+  }
+  int Result = runPort(Tool, Ports, Compilations);
+  if (!Results::close() && Result == 0)
+    Result = 1;
+  return Result;
+}
+
+// Applies the merged fixes of all shards in -shard-dir.
+int mergeShardFixes() {
+  std::map<std::string, Replacements> Merged;
+  std::vector<Utils::RankedReplacement> Accepted;
+  bool Clean = mergeShards(ShardDir, Merged, Accepted, llvm::errs());
+
+  if (!ResultsFile.empty()) {
+    // The rules the shards ran, by rank.
+    std::map<unsigned, std::string> Ranked;
+    for (const Utils::RankedReplacement &Fix : Accepted)
+      Ranked.insert(std::make_pair(Fix.Priority, Fix.Rule));
+    std::vector<std::string> Rules;
+    for (const auto &Rule : Ranked)
+      Rules.push_back(Rule.second);
+    if (!Results::open(ResultsFile, ResultsFormat, Rules))
+      return 1;
+  }
+
+  int Result;
+  if (Diff::enabled()) {
+    Diff::addReplacements(Accepted);
+    Result = Diff::close() ? 0 : 1;
+  } else {
+    Results::addReplacements(Accepted);
+    FileManager Files((FileSystemOptions()));
+    Result = saveReplacements(Files, Merged, "merge-shards");
+  }
+  if (!Results::close())
+    Result = 1;
+  return Clean ? Result : 1;
+}
+
+// The arguments a worker gets: everything but the source files and the
+// options only the parent acts on.
+static std::vector<std::string> workerArguments(int argc, char **argv) {
+  static const char *const ParentOnly[] = {
+    "trace", "memory-stats", "verify", "verify-qt5-include", "verify-qt4-include",
+    "rebuild-impact", "j", "tu-timeout", "tu-memory-limit", "shard", "shard-dir",
+    "results", "results-format", "diff"
+  };
+  static const char *const TakesValue[] = {
+    "trace", "verify-qt5-include", "verify-qt4-include", "j", "tu-timeout",
+    "tu-memory-limit", "shard", "shard-dir", "results", "results-format"
+  };
+  std::set<std::string> Sources(SourcePaths.begin(), SourcePaths.end());
+
+  std::vector<std::string> Args(1, argv[0]);
+  for (int I = 1; I < argc; ++I) {
+    StringRef Arg = argv[I];
+    if (Sources.count(Arg.str()))
+      continue;
+    StringRef Name = Arg.startswith("--") ? Arg.substr(2) : Arg.startswith("-") ? Arg.substr(1) : StringRef();
+    StringRef Key = Name.split('=').first;
+    if (Name.empty() || std::find(std::begin(ParentOnly), std::end(ParentOnly), Key) == std::end(ParentOnly)) {
+      Args.push_back(Arg.str());
+      continue;
+    }
+    // "-j 4": skip the value as well.
+    if (!Name.count('=') && std::find(std::begin(TakesValue), std::end(TakesValue), Key) != std::end(TakesValue))
+      ++I;
+  }
+  return Args;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  if ((!Shard.empty() || MergeShards) && ShardDir.empty())
+    llvm::report_fatal_error("-shard and -merge-shards need -shard-dir");
+  if (!Shard.empty() && !parseShard(Shard, ShardIndex, ShardCount))
+    llvm::report_fatal_error("-shard expects i/N with 0 <= i < N");
+  if (DiffFile.getNumOccurrences() && (!Shard.empty() || VerifyRewrites || RebuildImpact))
+    llvm::report_fatal_error("-diff rewrites nothing, so it cannot be combined with -shard, -verify or -rebuild-impact");
+  if (!ResultsFile.empty() && !Shard.empty())
+    llvm::report_fatal_error("a shard does not know what the merge keeps; pass -results to -merge-shards");
+  if (DiffFile.getNumOccurrences() && !Diff::open(DiffFile.empty() ? "-" : DiffFile, SourceDir))
+    return 1;
+  if (MergeShards)
+    return mergeShardFixes();
+  if (SourcePaths.empty())
+    llvm::report_fatal_error("no source files given");
+  // Workers allocate in processes of their own; the watchdog reports their
+  // peak RSS instead.
+  if (MemoryStats && (TUTimeout || TUMemoryLimit))
+    llvm::report_fatal_error("-memory-stats counts this process only; with -tu-timeout and -tu-memory-limit, "
+                             "the peak RSS of each TU is in the watchdog report");
+  if (TUTimeout || TUMemoryLimit) {
+    Workers.Program = sys::fs::getMainExecutable(argv[0], (void *)&jobCount);
+    Workers.Args = workerArguments(argc, argv);
+    Workers.TimeoutSeconds = TUTimeout;
+    Workers.MemoryLimitMB = TUMemoryLimit;
+    Workers.Jobs = jobCount();
+  }
+
+  if (!TraceFile.empty())
+    Trace::enable();
+  if (MemoryStats || !TraceFile.empty())
+    Memory::enable();
+
+  std::string ErrorMessage;
+  std::unique_ptr<CompilationDatabase> Compilations(
+    CompilationDatabase::loadFromDirectory(BuildPath, ErrorMessage));
+
+
+  if (!Compilations)
+    llvm::report_fatal_error(ErrorMessage);
+
+  int Result;
+  if (TraceFile.empty()) {
+    Result = portSelected(*Compilations);
+  } else {
+    Result = portSelected(Trace::CompilationDatabase(*Compilations));
+    if (!Trace::write(TraceFile) && Result == 0)
+      Result = 1;
+  }
 
-  return 1; // No useful arguments.
+  if (MemoryStats)
+    Memory::report(llvm::errs());
+  return Result;
 }
@@ -0,0 +1,80 @@
+//===- Qt4To5Plugin.h - Interface for rules loaded from plugins -----------===//
+//
+//  A plugin is a shared library, passed with -plugin=<file>, that adds rules
+//  to the MatchFinder the built-in rules run in, so that they share its
+//  single parse of each TU. It defines its entry point with QT4TO5_PLUGIN:
+//
+//    static void registerRules(Qt4To5Rules &Rules) {
+//      MatchFinder::MatchCallback *Callback = Rules.addRule(
+//          "port-myframework-widget", "PortWidget", new PortWidget(Rules));
+//      Rules.finder().addMatcher(..., Callback);
+//    }
+//    QT4TO5_PLUGIN("myframework", registerRules)
+//
+//  Callbacks write through Qt4To5Rules::addReplacement so that -verify,
+//  -rebuild-impact, shards and workers see their replacements. Plugins must
+//  be built against the same Clang as qt4to5; build them as modules that
+//  leave the Clang symbols undefined, to be resolved against the executable.
+//
+//  QT4TO5_PLUGIN_API_VERSION changes whenever Qt4To5Rules or
+//  Qt4To5PluginInfo change incompatibly; qt4to5 refuses plugins built for a
+//  different version or Clang.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_QT4TO5PLUGIN_H
+#define QT4TO5_QT4TO5PLUGIN_H
+
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/Version.h"
+#include "clang/Tooling/Refactoring.h"
+
+#define QT4TO5_PLUGIN_API_VERSION 1
+
+class Qt4To5Rules {
+ public:
+  virtual ~Qt4To5Rules() {}
+
+  // The MatchFinder shared by all rules.
+  virtual clang::ast_matchers::MatchFinder &finder() = 0;
+
+  // Takes ownership of Callback and returns the callback to register the
+  // matchers of rule Id with, so that the rule shows up in -trace,
+  // -memory-stats and -verify. Name is the callback's name in traces.
+  virtual clang::ast_matchers::MatchFinder::MatchCallback *
+  addRule(const char *Id, const char *Name,
+          clang::ast_matchers::MatchFinder::MatchCallback *Callback) = 0;
+
+  // Adds Replacement to the replacements of the run. Conflicts are resolved
+  // once all TUs are done, in favour of the rule registered first. Returns
+  // false if the file of Replacement is unknown.
+  virtual bool addReplacement(const clang::SourceManager &SourceManager,
+                              const clang::tooling::Replacement &Replacement) = 0;
+
+  // Whether -create-ifdefs was given.
+  virtual bool createIfdefs() const = 0;
+
+  // Keeps the current text of the lines Range is on in the Qt 4 branch of
+  // an #if QT_VERSION, as the built-in rules do with -create-ifdefs.
+  virtual void addIfdef(clang::SourceManager &SourceManager,
+                        clang::SourceRange Range) = 0;
+};
+
+struct Qt4To5PluginInfo {
+  unsigned APIVersion;
+  const char *ClangVersion;
+  const char *Name;
+  void (*Register)(Qt4To5Rules &Rules);
+};
+
+#define QT4TO5_PLUGIN(Name, RegisterFunction)                                  \
+  extern "C" __attribute__((visibility("default")))                           \
+  const Qt4To5PluginInfo *qt4to5_plugin_info() {                              \
+    static const Qt4To5PluginInfo Info = {                                     \
+      QT4TO5_PLUGIN_API_VERSION, CLANG_VERSION_STRING, Name, RegisterFunction  \
+    };                                                                         \
+    return &Info;                                                              \
+  }
+
+#endif
@@ -0,0 +1,182 @@
+#include "Results.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Trace.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+
+namespace Results {
+  namespace {
+    struct Result {
+      std::string Rule;
+      std::string File;
+      unsigned Offset;
+      unsigned Length;
+      unsigned Line, Column, EndLine, EndColumn;
+      std::string Old;
+      std::string New;
+      bool Ifdef;
+    };
+
+    std::mutex Lock;
+    std::unique_ptr<raw_fd_ostream> Out;
+    Format OutputFormat = JSONLines;
+    bool FirstResult = true;
+
+    // A source file and the offsets its lines start at.
+    struct Source {
+      std::string Path;
+      std::unique_ptr<MemoryBuffer> Buffer;
+      std::vector<unsigned> LineStarts;
+
+      bool load(const std::string &File) {
+        Path = File;
+        LineStarts.clear();
+        ErrorOr<std::unique_ptr<MemoryBuffer> > Read = MemoryBuffer::getFile(File);
+        if (!Read) {
+          Buffer.reset();
+          errs() << "results: cannot read " << File << ": " << Read.getError().message() << "\n";
+          return false;
+        }
+        Buffer = std::move(*Read);
+        StringRef Code = Buffer->getBuffer();
+        LineStarts.push_back(0);
+        for (size_t I = 0; I < Code.size(); ++I) {
+          if (Code[I] == '\n')
+            LineStarts.push_back(I + 1);
+        }
+        return true;
+      }
+
+      // 1-based, as SourceManager counts.
+      void position(unsigned Offset, unsigned &Line, unsigned &Column) const {
+        Line = std::upper_bound(LineStarts.begin(), LineStarts.end(), Offset) - LineStarts.begin();
+        Column = Offset - LineStarts[Line - 1] + 1;
+      }
+    };
+
+    void writeJSONLine(raw_ostream &OS, const Result &R) {
+      OS << "{\"rule\":";
+      Trace::writeString(OS, R.Rule);
+      OS << ",\"file\":";
+      Trace::writeString(OS, R.File);
+      OS << ",\"offset\":" << R.Offset << ",\"length\":" << R.Length
+         << ",\"line\":" << R.Line << ",\"column\":" << R.Column
+         << ",\"endLine\":" << R.EndLine << ",\"endColumn\":" << R.EndColumn
+         << ",\"old\":";
+      Trace::writeString(OS, R.Old);
+      OS << ",\"new\":";
+      Trace::writeString(OS, R.New);
+      OS << ",\"ifdef\":" << (R.Ifdef ? "true" : "false") << "}\n";
+    }
+
+    void writeSARIF(raw_ostream &OS, const Result &R) {
+      std::string URI = "file://" + R.File;
+      OS << (FirstResult ? "\n" : ",\n") << "{\"ruleId\":";
+      Trace::writeString(OS, R.Rule);
+      OS << ",\"level\":\"note\",\"message\":{\"text\":";
+      Trace::writeString(OS, R.Ifdef ? "Qt 4 code ported to Qt 5 behind #if QT_VERSION"
+                                     : "Qt 4 code ported to Qt 5");
+      OS << "},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":";
+      Trace::writeString(OS, URI);
+      OS << "},\"region\":{\"startLine\":" << R.Line << ",\"startColumn\":" << R.Column
+         << ",\"endLine\":" << R.EndLine << ",\"endColumn\":" << R.EndColumn
+         << ",\"snippet\":{\"text\":";
+      Trace::writeString(OS, R.Old);
+      OS << "}}}}],\"fixes\":[{\"artifactChanges\":[{\"artifactLocation\":{\"uri\":";
+      Trace::writeString(OS, URI);
+      OS << "},\"replacements\":[{\"deletedRegion\":{\"charOffset\":" << R.Offset
+         << ",\"charLength\":" << R.Length << "},\"insertedContent\":{\"text\":";
+      Trace::writeString(OS, R.New);
+      OS << "}}]}]}],\"properties\":{\"ifdef\":" << (R.Ifdef ? "true" : "false") << "}}";
+    }
+  }
+
+  bool open(StringRef Path, Format F, const std::vector<std::string> &Rules) {
+    std::error_code EC;
+    Out.reset(new raw_fd_ostream(Path, EC, sys::fs::F_Text));
+    if (EC) {
+      errs() << "results: cannot write " << Path << ": " << EC.message() << "\n";
+      Out.reset();
+      return false;
+    }
+    OutputFormat = F;
+    if (OutputFormat == SARIF) {
+      *Out << "{\"version\":\"2.1.0\","
+              "\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+              "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"qt4to5\",\"rules\":[";
+      for (size_t I = 0; I < Rules.size(); ++I) {
+        *Out << (I ? "," : "") << "{\"id\":";
+        Trace::writeString(*Out, Rules[I]);
+        *Out << "}";
+      }
+      *Out << "]}},\"results\":[";
+    }
+    return true;
+  }
+
+  bool enabled() {
+    return Out != nullptr;
+  }
+
+  void addReplacements(const std::vector<Utils::RankedReplacement> &Fixes) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Out)
+      return;
+    // Merged replacements come sorted by file, so each is read once.
+    Source File;
+    bool Loaded = false;
+    for (const Utils::RankedReplacement &Fix : Fixes) {
+      if (Fix.Ifdef)
+        continue;
+      std::string Path = Utils::NormalizePath(Fix.Fix.getFilePath());
+      if (Path != File.Path)
+        Loaded = File.load(Path);
+      if (!Loaded)
+        continue;
+      StringRef Code = File.Buffer->getBuffer();
+      if (Fix.Fix.getOffset() + Fix.Fix.getLength() > Code.size())
+        continue;
+
+      Result R;
+      R.Rule = Fix.Rule;
+      R.File = Path;
+      R.Offset = Fix.Fix.getOffset();
+      R.Length = Fix.Fix.getLength();
+      File.position(R.Offset, R.Line, R.Column);
+      File.position(R.Offset + R.Length, R.EndLine, R.EndColumn);
+      R.Old = Code.substr(R.Offset, R.Length).str();
+      R.New = Fix.Fix.getReplacementText().str();
+      R.Ifdef = Fix.Guarded;
+      if (OutputFormat == SARIF)
+        writeSARIF(*Out, R);
+      else
+        writeJSONLine(*Out, R);
+      FirstResult = false;
+    }
+    Out->flush();
+  }
+
+  bool close() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Out)
+      return true;
+    if (OutputFormat == SARIF)
+      *Out << "\n]}]}\n";
+    Out->close();
+    bool Failed = Out->has_error();
+    if (Failed)
+      Out->clear_error();
+    Out.reset();
+    return !Failed;
+  }
+}
@@ -0,0 +1,41 @@
+//===- Results.h - Machine-readable results of a porting run --------------===//
+//
+//  With -results=<file>, every replacement a rule makes is written out with
+//  the rule, its location, the old and new text and whether an #if was
+//  created for it, either as JSON Lines (one object per replacement) or as a
+//  SARIF 2.1.0 log. Results are written from the merged replacements, so
+//  they list exactly what is applied: a header edit made from several TUs
+//  once, and nothing that was dropped in a conflict.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_RESULTS_H
+#define QT4TO5_RESULTS_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+#include "Utils.h"
+
+namespace Results {
+  enum Format { JSONLines, SARIF };
+
+  // Opens Path ("-" for stdout) and writes what comes before the first
+  // result. Rules are listed as the rules of the SARIF driver.
+  bool open(llvm::StringRef Path, Format F, const std::vector<std::string> &Rules);
+  bool enabled();
+
+  // Writes a result for each of Fixes, as accepted by a merge, but the
+  // #if lines of -create-ifdefs. Lines, columns and the old text are taken
+  // from the files on disk, so this has to be called before they are
+  // rewritten.
+  void addReplacements(const std::vector<Utils::RankedReplacement> &Fixes);
+
+  // Writes what comes after the last result and closes the file. Returns
+  // false on I/O errors.
+  bool close();
+}
+
+#endif
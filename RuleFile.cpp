@@ -0,0 +1,199 @@
+#include "RuleFile.h"
+
+#include <string>
+#include <vector>
+
+#include "clang/ASTMatchers/Dynamic/Parser.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include "SourceHelpers.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace llvm;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace {
+struct RuleSpec {
+  std::string Id;
+  std::string Match;
+  std::string Node;
+  std::string Replacement;
+};
+} // end namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(RuleSpec)
+
+namespace llvm {
+namespace yaml {
+template <> struct MappingTraits<RuleSpec> {
+  static void mapping(IO &IO, RuleSpec &Rule) {
+    IO.mapRequired("id", Rule.Id);
+    IO.mapRequired("match", Rule.Match);
+    IO.mapOptional("node", Rule.Node, std::string("root"));
+    IO.mapRequired("replacement", Rule.Replacement);
+  }
+};
+} // end namespace yaml
+} // end namespace llvm
+
+namespace {
+// A piece of a replacement template: literal text, or the name of a bound
+// node whose text goes there.
+struct Segment {
+  bool IsNode;
+  std::string Text;
+};
+
+bool parseTemplate(StringRef Template, std::vector<Segment> &Segments,
+                   std::string &Error) {
+  std::string Literal;
+  while (!Template.empty()) {
+    size_t Dollar = Template.find('$');
+    Literal += Template.substr(0, Dollar).str();
+    if (Dollar == StringRef::npos)
+      break;
+    Template = Template.substr(Dollar + 1);
+    if (Template.startswith("$")) {
+      Literal += '$';
+      Template = Template.substr(1);
+      continue;
+    }
+    size_t Close = Template.find('}');
+    if (!Template.startswith("{") || Close == StringRef::npos || Close == 1) {
+      Error = "expected ${name} or $$ in replacement";
+      return false;
+    }
+    if (!Literal.empty()) {
+      Segment S = { false, Literal };
+      Segments.push_back(S);
+      Literal.clear();
+    }
+    Segment S = { true, Template.substr(1, Close - 1).str() };
+    Segments.push_back(S);
+    Template = Template.substr(Close + 1);
+  }
+  if (!Literal.empty()) {
+    Segment S = { false, Literal };
+    Segments.push_back(S);
+  }
+  return true;
+}
+
+// Gives a bound node's range the interface the source helpers expect.
+struct NodeRange {
+  NodeRange(SourceRange Range) : Range(Range) {}
+
+  SourceLocation getLocStart() const { return Range.getBegin(); }
+  SourceLocation getLocEnd() const { return Range.getEnd(); }
+
+  SourceRange Range;
+};
+
+class TemplateRule : public MatchFinder::MatchCallback {
+ public:
+  TemplateRule(const std::string &Node, const std::vector<Segment> &Template,
+               bool CreateIfdefs, std::map<std::string, Replacements> *Replace)
+      : Node(Node), Template(Template), CreateIfdefs(CreateIfdefs),
+        Replace(Replace) {}
+
+  virtual void run(const MatchFinder::MatchResult &Result) {
+    const BoundNodes::IDToNodeMap &Nodes = Result.Nodes.getMap();
+    SourceManager &SM = *Result.SourceManager;
+
+    BoundNodes::IDToNodeMap::const_iterator Target = Nodes.find(Node);
+    if (Target == Nodes.end())
+      return;
+
+    // A node the template refers to can be unbound, e.g. in an anyOf();
+    // leave such matches alone.
+    std::string Text;
+    for (const Segment &S : Template) {
+      if (!S.IsNode) {
+        Text += S.Text;
+        continue;
+      }
+      BoundNodes::IDToNodeMap::const_iterator Bound = Nodes.find(S.Text);
+      if (Bound == Nodes.end())
+        return;
+      std::string NodeText = getText(SM, NodeRange(Bound->second.getSourceRange()));
+      if (NodeText.empty())
+        return;
+      Text += NodeText;
+    }
+
+    NodeRange Range(Target->second.getSourceRange());
+    SourceLocation Start = SM.getSpellingLoc(Range.getLocStart());
+    SourceLocation End = SM.getSpellingLoc(Range.getLocEnd());
+    if (!Start.isValid() || !End.isValid())
+      return;
+
+    Utils::AddReplacement(
+      SM.getFileEntryForID(SM.getFileID(Start)),
+      Replacement(SM, CharSourceRange::getTokenRange(Start, End), Text),
+      Replace
+    );
+
+    if (CreateIfdefs)
+      insertIfdef(Result.SourceManager, &Range, Replace);
+  }
+
+ private:
+  std::string Node;
+  std::vector<Segment> Template;
+  bool CreateIfdefs;
+  std::map<std::string, Replacements> *Replace;
+};
+} // end namespace
+
+bool addRuleFile(StringRef Path, PortRegistry &Ports, bool CreateIfdefs,
+                 raw_ostream &Errors) {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    Errors << Path << ": " << Buffer.getError().message() << "\n";
+    return false;
+  }
+
+  std::vector<RuleSpec> Specs;
+  yaml::Input YAML((*Buffer)->getBuffer());
+  YAML >> Specs;
+  if (YAML.error()) {
+    Errors << Path << ": " << YAML.error().message() << "\n";
+    return false;
+  }
+
+  bool Valid = true;
+  for (const RuleSpec &Spec : Specs) {
+    dynamic::Diagnostics Diag;
+    llvm::Optional<internal::DynTypedMatcher> Matcher =
+        dynamic::Parser::parseMatcherExpression(Spec.Match, &Diag);
+    if (!Matcher) {
+      Errors << Path << ": " << Spec.Id << ": " << Diag.toStringFull() << "\n";
+      Valid = false;
+      continue;
+    }
+    llvm::Optional<internal::DynTypedMatcher> Bound = Matcher->tryBind("root");
+    if (Bound)
+      Matcher = Bound;
+
+    std::vector<Segment> Template;
+    std::string Error;
+    if (!parseTemplate(Spec.Replacement, Template, Error)) {
+      Errors << Path << ": " << Spec.Id << ": " << Error << "\n";
+      Valid = false;
+      continue;
+    }
+
+    MatchFinder::MatchCallback *Callback = Ports.addRule(
+        Spec.Id, "TemplateRule",
+        new TemplateRule(Spec.Node, Template, CreateIfdefs, Ports.replacements()));
+    if (!Ports.finder().addDynamicMatcher(*Matcher, Callback)) {
+      Errors << Path << ": " << Spec.Id << ": matcher cannot be used at the top level\n";
+      Valid = false;
+    }
+  }
+  return Valid;
+}
@@ -0,0 +1,33 @@
+//===- RuleFile.h - Porting rules declared in YAML files ------------------===//
+//
+//  A rules file lists rules that need no code of their own: a matcher in the
+//  syntax of clang-query, parsed with Clang's dynamic matcher parser, and a
+//  template for the text that replaces one of the nodes it binds.
+//
+//    - id: port-qstring-fromascii
+//      match: 'callExpr(callee(functionDecl(hasName("::QString::fromAscii"))),
+//                       hasArgument(0, expr().bind("arg"))).bind("call")'
+//      node: call
+//      replacement: 'QString::fromLatin1(${arg})'
+//
+//  "${name}" stands for the source text of the node bound to name and "$$"
+//  for a literal "$". node defaults to "root", which is bound to the whole
+//  match.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_RULEFILE_H
+#define QT4TO5_RULEFILE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PortAction.h"
+
+// Parses the rules in Path and adds them to Ports. With CreateIfdefs, every
+// replacement keeps the Qt 4 line in an #if like the built-in rules do.
+// Reports every invalid rule to Errors and returns false if there was one.
+bool addRuleFile(llvm::StringRef Path, PortRegistry &Ports, bool CreateIfdefs,
+                 llvm::raw_ostream &Errors);
+
+#endif
@@ -0,0 +1,106 @@
+#include "Shard.h"
+
+#include <algorithm>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "Fixes.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace {
+std::string shardFileName(unsigned Index, unsigned Count) {
+  return "shard-" + std::to_string(Index) + "-of-" + std::to_string(Count) +
+         ".yaml";
+}
+
+uint64_t fileCost(const std::string &File) {
+  uint64_t Size = 0;
+  if (sys::fs::file_size(File, Size))
+    return 0;
+  return Size;
+}
+} // end namespace
+
+bool parseShard(StringRef Spec, unsigned &Index, unsigned &Count) {
+  std::pair<StringRef, StringRef> Parts = Spec.split('/');
+  if (Parts.first.getAsInteger(10, Index) || Parts.second.getAsInteger(10, Count))
+    return false;
+  return Count > 0 && Index < Count;
+}
+
+std::vector<std::string> filesForShard(const std::vector<std::string> &Files,
+                                       unsigned Index, unsigned Count) {
+  std::vector<std::pair<uint64_t, std::string> > ByCost;
+  for (const std::string &File : Files)
+    ByCost.push_back(std::make_pair(fileCost(File), File));
+  // Largest first; the name breaks ties so the order is total.
+  std::sort(ByCost.begin(), ByCost.end(),
+            [](const std::pair<uint64_t, std::string> &A,
+               const std::pair<uint64_t, std::string> &B) {
+              return A.first != B.first ? A.first > B.first : A.second < B.second;
+            });
+
+  std::vector<uint64_t> Load(Count, 0);
+  std::vector<std::string> Result;
+  for (const auto &File : ByCost) {
+    unsigned Least = std::min_element(Load.begin(), Load.end()) - Load.begin();
+    // A file of size 0 still costs a parse.
+    Load[Least] += File.first + 1;
+    if (Least == Index)
+      Result.push_back(File.second);
+  }
+  return Result;
+}
+
+bool exportShard(StringRef Dir, unsigned Index, unsigned Count,
+                 const std::vector<Utils::RankedReplacement> &Fixes,
+                 bool Complete, raw_ostream &Errors) {
+  SmallString<256> Path(Dir);
+  sys::path::append(Path, shardFileName(Index, Count));
+  return writeFixes(Path, shardFileName(Index, Count), Fixes, Complete, Errors);
+}
+
+bool mergeShards(StringRef Dir, std::map<std::string, Replacements> &Merged,
+                 std::vector<Utils::RankedReplacement> &Accepted,
+                 raw_ostream &Errors) {
+  // Find the shard count from any shard file, then require all of them.
+  unsigned Count = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC; I.increment(EC)) {
+    StringRef Name = sys::path::filename(I->path());
+    unsigned Index, N;
+    if (Name.startswith("shard-") && Name.endswith(".yaml") &&
+        !Name.drop_front(6).split("-of-").first.getAsInteger(10, Index) &&
+        !Name.split("-of-").second.drop_back(5).getAsInteger(10, N))
+      Count = std::max(Count, N);
+  }
+  if (EC || Count == 0) {
+    Errors << "merge: no shard fixes in " << Dir << "\n";
+    return false;
+  }
+
+  std::vector<Utils::RankedReplacement> Fixes;
+  bool Readable = true, Complete = true;
+  for (unsigned Index = 0; Index < Count; ++Index) {
+    SmallString<256> Path(Dir);
+    sys::path::append(Path, shardFileName(Index, Count));
+    bool ShardComplete = true;
+    if (!readFixes(Path, Fixes, Errors, &ShardComplete)) {
+      Readable = false;
+    } else if (!ShardComplete) {
+      Errors << "merge: shard " << Index << " of " << Count
+             << " is incomplete, some of its TUs failed\n";
+      Complete = false;
+    }
+  }
+  if (!Readable)
+    return false;
+
+  Utils::MergeReplacements(std::move(Fixes), Merged, Errors, &Accepted);
+  return Complete;
+}
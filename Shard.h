@@ -0,0 +1,52 @@
+//===- Shard.h - Splitting a run across machines --------------------------===//
+//
+//  With -shard=i/N every machine ports a deterministic, cost-balanced share
+//  of the TUs and writes its replacements to a fixes file in a shared
+//  directory instead of editing the sources. -merge-shards then combines the
+//  fixes of all N shards into one replacement set and applies it. The shared
+//  directory is the only coordination needed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_SHARD_H
+#define QT4TO5_SHARD_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Utils.h"
+
+// Parses "i/N" with 0 <= i < N.
+bool parseShard(llvm::StringRef Spec, unsigned &Index, unsigned &Count);
+
+// Returns the files shard Index of Count has to port. Files are assigned,
+// largest first, to the shard with the least total size so far; every
+// machine computes the same assignment from the same file list.
+std::vector<std::string> filesForShard(const std::vector<std::string> &Files,
+                                       unsigned Index, unsigned Count);
+
+// Writes the replacements of shard Index of Count to Dir, marked as
+// incomplete unless Complete, i.e. if some of its TUs failed. The file
+// appears under its final name only once it is written.
+bool exportShard(llvm::StringRef Dir, unsigned Index, unsigned Count,
+                 const std::vector<Utils::RankedReplacement> &Fixes,
+                 bool Complete, llvm::raw_ostream &Errors);
+
+// Reads the fixes of all shards in Dir into Merged and appends what was
+// merged to Accepted. Identical replacements from several shards (typically
+// header edits) are kept once; of conflicting ones the one of the rule
+// ranked first is kept, as in a single process, and the others are
+// reported. Incomplete shards are reported and still merged. Returns false
+// if a shard is missing, unreadable or incomplete; nothing is merged if one
+// is missing or unreadable.
+bool mergeShards(llvm::StringRef Dir,
+                 std::map<std::string, clang::tooling::Replacements> &Merged,
+                 std::vector<Utils::RankedReplacement> &Accepted,
+                 llvm::raw_ostream &Errors);
+
+#endif
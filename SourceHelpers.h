@@ -0,0 +1,170 @@
+//===- SourceHelpers.h - Source text helpers used by the callbacks --------===//
+//
+//  Templates over anything with getLocStart()/getLocEnd(), so that they work
+//  on any AST node and can be benchmarked on synthetic buffers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_SOURCEHELPERS_H
+#define QT4TO5_SOURCEHELPERS_H
+
+#include <map>
+#include <string>
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Utils.h"
+
+// Returns the text that makes up 'node' in the source.
+// Returns an empty string if the text cannot be found.
+template <typename T>
+std::string getText(const clang::SourceManager &SourceManager, const T &Node) {
+  using namespace clang;
+
+  SourceLocation StartSpellingLocation =
+      SourceManager.getSpellingLoc(Node.getLocStart());
+  SourceLocation EndSpellingLocation =
+      SourceManager.getSpellingLoc(Node.getLocEnd());
+  if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
+    return std::string();
+  }
+  bool Invalid = true;
+  const char *Text =
+      SourceManager.getCharacterData(StartSpellingLocation, &Invalid);
+  if (Invalid) {
+    return std::string();
+  }
+  std::pair<FileID, unsigned> Start =
+      SourceManager.getDecomposedLoc(StartSpellingLocation);
+  std::pair<FileID, unsigned> End =
+      SourceManager.getDecomposedLoc(Lexer::getLocForEndOfToken(
+          EndSpellingLocation, 0, SourceManager, LangOptions()));
+  if (Start.first != End.first) {
+    // Start and end are in different files.
+    llvm::errs() << "Start and end are in different files. " << Start.first.getHashValue() << " -- " << End.first.getHashValue() << "\n";
+    return std::string();
+  }
+  if (End.second < Start.second) {
+    // Shuffling text with macros may cause this.
+    llvm::errs() << "Shuffling text with macros may cause this." << Start.second << " -- " << End.second << "\n";
+    return std::string();
+  }
+  return std::string(Text, End.second - Start.second);
+}
+
+// Keeps the lines of 'node' as they are for Qt versions before QtVersion
+// ("major, minor, patch") behind an #if; the rewritten lines go in the #else.
+template <typename T>
+void insertIfdef(clang::SourceManager * const SourceManager, const T *Node, std::map<std::string, clang::tooling::Replacements> *Replace,
+                 const char *QtVersion = "5, 0, 0")
+{
+  using namespace clang;
+  using clang::tooling::Replacement;
+
+  SourceLocation StartSpellingLocation =
+      SourceManager->getSpellingLoc(Node->getLocStart());
+  SourceLocation EndSpellingLocation =
+      SourceManager->getSpellingLoc(Node->getLocEnd());
+  if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
+    return;
+  }
+
+  FullSourceLoc fs(StartSpellingLocation, *SourceManager);
+
+  bool Invalid = true;
+  SourceLocation StartOfLine = StartSpellingLocation.getLocWithOffset(-fs.getSpellingColumnNumber(&Invalid) + 1);
+  if (Invalid) {
+    return;
+  }
+
+  const char *Text =
+      SourceManager->getCharacterData(StartOfLine, &Invalid);
+  std::pair<FileID, unsigned> Start =
+      SourceManager->getDecomposedLoc(StartOfLine);
+  std::pair<FileID, unsigned> End =
+      SourceManager->getDecomposedLoc(Lexer::getLocForEndOfToken(
+          EndSpellingLocation, 0, *SourceManager, LangOptions()));
+  if (Start.first != End.first) {
+    llvm::errs() << "Start and end are in different files. " << Start.first.getHashValue() << " -- " << End.first.getHashValue() << "\n";
+    return;
+  }
+  if (End.second < Start.second) {
+    llvm::errs() << "Shuffling text with macros may cause this." << Start.second << " -- " << End.second << "\n";
+    return;
+  }
+
+  unsigned eol = End.second - Start.second;
+  while (Text[eol] != '\n') {
+    ++eol;
+  }
+
+  std::string ExistingText = std::string(Text, eol);
+
+  SourceLocation EndOfLine = StartOfLine.getLocWithOffset(eol);
+  
+  Utils::AddReplacement(
+      SourceManager->getFileEntryForID(Start.first),
+      Replacement(*SourceManager, StartOfLine, 0, "#if QT_VERSION < QT_VERSION_CHECK(" + std::string(QtVersion) + ")\n" + ExistingText + "\n#else\n"),
+      Replace,
+      true
+    );
+  //Replace->add(Replacement(*SourceManager, StartOfLine, 0, "#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)\n" + ExistingText + "\n#else\n"));
+  Utils::AddReplacement(
+      SourceManager->getFileEntryForID(Start.first),
+      Replacement(*SourceManager, EndOfLine, 0, "\n#endif"),
+      Replace,
+      true
+  );
+  //Replace->add(Replacement(*SourceManager, EndOfLine, 0, "\n#endif"));
+}
+
+// Computes the range that removes Arg together with everything between the
+// end of PrevArg and it, e.g. ", 0" in "text(key, 0)". File is set to the
+// file the range is in. Returns false if the range cannot be computed.
+template <typename T>
+bool getArgumentRemovalRange(const clang::SourceManager &SourceManager, const T &PrevArg, const T &Arg,
+                             clang::CharSourceRange &Range, clang::FileID &File)
+{
+  using namespace clang;
+
+  SourceLocation StartSpellingLocation =
+      SourceManager.getSpellingLoc(PrevArg.getLocEnd());
+
+  SourceLocation EndSpellingLocation =
+      SourceManager.getSpellingLoc(Arg.getLocEnd());
+  if (!StartSpellingLocation.isValid() || !EndSpellingLocation.isValid()) {
+    return false;
+  }
+  std::pair<FileID, unsigned> Start =
+      SourceManager.getDecomposedLoc(Lexer::getLocForEndOfToken(
+          StartSpellingLocation, 0, SourceManager, LangOptions()));
+  std::pair<FileID, unsigned> End =
+      SourceManager.getDecomposedLoc(Lexer::getLocForEndOfToken(
+          EndSpellingLocation, 0, SourceManager, LangOptions()));
+  if (Start.first != End.first) {
+    // Start and end are in different files.
+    llvm::errs() << "Start and end are in different files. " << Start.first.getHashValue() << " -- " << End.first.getHashValue() << "\n";
+    return false;
+  }
+  if (End.second < Start.second) {
+    // Shuffling text with macros may cause this.
+    llvm::errs() << "Shuffling text with macros may cause this." << Start.second << " -- " << End.second << "\n";
+    return false;
+  }
+
+  // PrevArg.getLocEnd() doesn't get the end of the token, but the start.
+  // Use this hack to get the real ends.
+  SourceLocation StartOfFile = StartSpellingLocation.getLocWithOffset(-SourceManager.getFileOffset(PrevArg.getLocStart()));
+  StartSpellingLocation = StartOfFile.getLocWithOffset(Start.second);
+  EndSpellingLocation = StartOfFile.getLocWithOffset(End.second);
+
+  Range.setBegin(StartSpellingLocation);
+  Range.setEnd(EndSpellingLocation);
+  File = Start.first;
+  return true;
+}
+
+#endif
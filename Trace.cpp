@@ -0,0 +1,159 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace Trace {
+  namespace {
+    struct Event {
+      std::string Name;
+      std::string Detail;
+      unsigned Thread;
+      uint64_t Start;
+      uint64_t Duration;
+      Arguments Args;
+    };
+
+    std::atomic<bool> Enabled(false);
+    std::chrono::steady_clock::time_point Epoch;
+    std::mutex Lock;
+    std::vector<Event> Events;
+    std::atomic<unsigned> NextThread(0);
+
+    // Small, stable ids read better in the viewer than native thread ids.
+    unsigned threadId() {
+      static thread_local unsigned Id = NextThread++;
+      return Id;
+    }
+  }
+
+  void writeString(raw_ostream &OS, StringRef S) {
+    OS << '"';
+    for (char C : S) {
+      switch (C) {
+      case '"': OS << "\\\""; break;
+      case '\\': OS << "\\\\"; break;
+      case '\n': OS << "\\n"; break;
+      case '\t': OS << "\\t"; break;
+      default:
+        if ((unsigned char)C < 0x20)
+          OS << format("\\u%04x", (unsigned char)C);
+        else
+          OS << C;
+      }
+    }
+    OS << '"';
+  }
+
+  void enable() {
+    Epoch = std::chrono::steady_clock::now();
+    // The enabling thread is shown as "main".
+    threadId();
+    Enabled = true;
+  }
+
+  bool enabled() {
+    return Enabled;
+  }
+
+  uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - Epoch).count();
+  }
+
+  void complete(StringRef Name, StringRef Detail, uint64_t Start,
+                const Arguments &Args) {
+    if (!Enabled)
+      return;
+    Event E;
+    E.Name = Name.str();
+    E.Detail = Detail.str();
+    E.Thread = threadId();
+    E.Start = Start;
+    E.Duration = now() - Start;
+    E.Args = Args;
+
+    std::lock_guard<std::mutex> Guard(Lock);
+    Events.push_back(std::move(E));
+  }
+
+  bool write(StringRef Path) {
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+    if (EC) {
+      errs() << "trace: cannot write " << Path << ": " << EC.message() << "\n";
+      return false;
+    }
+
+    std::lock_guard<std::mutex> Guard(Lock);
+    OS << "{\"traceEvents\":[\n";
+    OS << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+          "\"args\":{\"name\":\"qt4to5\"}}";
+    for (unsigned Thread = 0; Thread < NextThread; ++Thread) {
+      OS << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+         << Thread << ",\"args\":{\"name\":";
+      writeString(OS, Thread ? "worker " + std::to_string(Thread) : "main");
+      OS << "}}";
+    }
+    for (const Event &E : Events) {
+      OS << ",\n{\"name\":";
+      writeString(OS, E.Name);
+      OS << ",\"cat\":\"qt4to5\",\"ph\":\"X\",\"pid\":1,\"tid\":" << E.Thread
+         << ",\"ts\":" << E.Start << ",\"dur\":" << E.Duration
+         << ",\"args\":{";
+      bool First = true;
+      if (!E.Detail.empty()) {
+        OS << "\"detail\":";
+        writeString(OS, E.Detail);
+        First = false;
+      }
+      for (const auto &Arg : E.Args) {
+        if (!First)
+          OS << ",";
+        writeString(OS, Arg.first);
+        OS << ":";
+        writeString(OS, Arg.second);
+        First = false;
+      }
+      OS << "}}";
+    }
+    OS << "\n]}\n";
+    return true;
+  }
+
+  Scope::Scope(StringRef Name, StringRef Detail) : Active(Enabled), Start(0) {
+    if (!Active)
+      return;
+    this->Name = Name.str();
+    this->Detail = Detail.str();
+    Start = now();
+  }
+
+  Scope::~Scope() {
+    if (Active)
+      complete(Name, Detail, Start);
+  }
+
+  std::vector<clang::tooling::CompileCommand>
+  CompilationDatabase::getCompileCommands(StringRef FilePath) const {
+    Scope Span("Compile command lookup", FilePath);
+    return Inner.getCompileCommands(FilePath);
+  }
+
+  std::vector<std::string> CompilationDatabase::getAllFiles() const {
+    return Inner.getAllFiles();
+  }
+
+  std::vector<clang::tooling::CompileCommand>
+  CompilationDatabase::getAllCompileCommands() const {
+    return Inner.getAllCompileCommands();
+  }
+}
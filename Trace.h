@@ -0,0 +1,71 @@
+//===- Trace.h - Chrome trace-event recording -----------------------------===//
+//
+//  Records timed spans from every thread and writes them as Chrome
+//  trace-event JSON (load the file in chrome://tracing or Perfetto).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_TRACE_H
+#define QT4TO5_TRACE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Trace {
+  typedef std::vector<std::pair<std::string, std::string> > Arguments;
+
+  // Starts recording. Nothing is recorded until this is called.
+  void enable();
+  bool enabled();
+
+  // Microseconds since enable().
+  uint64_t now();
+
+  // Records a span that started at Start (from now()) and ends now.
+  void complete(llvm::StringRef Name, llvm::StringRef Detail, uint64_t Start,
+                const Arguments &Args = Arguments());
+
+  // Writes everything recorded so far to Path. Returns false on I/O errors.
+  bool write(llvm::StringRef Path);
+
+  // Writes S as a quoted JSON string.
+  void writeString(llvm::raw_ostream &OS, llvm::StringRef S);
+
+  // Records a span covering the lifetime of the object.
+  class Scope {
+   public:
+    Scope(llvm::StringRef Name, llvm::StringRef Detail = llvm::StringRef());
+    ~Scope();
+
+   private:
+    bool Active;
+    std::string Name;
+    std::string Detail;
+    uint64_t Start;
+  };
+
+  // Forwards to another database, recording each compile command lookup.
+  class CompilationDatabase : public clang::tooling::CompilationDatabase {
+   public:
+    CompilationDatabase(const clang::tooling::CompilationDatabase &Inner)
+        : Inner(Inner) {}
+
+    virtual std::vector<clang::tooling::CompileCommand>
+    getCompileCommands(llvm::StringRef FilePath) const;
+    virtual std::vector<std::string> getAllFiles() const;
+    virtual std::vector<clang::tooling::CompileCommand>
+    getAllCompileCommands() const;
+
+   private:
+    const clang::tooling::CompilationDatabase &Inner;
+  };
+}
+
+#endif
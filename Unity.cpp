@@ -0,0 +1,395 @@
+#include "Unity.h"
+
+#include <algorithm>
+#include <set>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include "Trace.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::CompileCommand;
+
+namespace {
+// What the lexical scan found out about a source file.
+struct FileScan {
+  FileScan() : Eligible(true), Lines(0) {}
+
+  bool Eligible;
+  unsigned Lines;
+  // Macros the file #defines or #undefs.
+  std::set<std::string> Macros;
+  // Names declared at file or namespace scope.
+  std::set<std::string> Names;
+  // Every identifier in the file.
+  std::set<std::string> Identifiers;
+};
+
+bool isHeader(StringRef Name) {
+  StringRef Extension = sys::path::extension(Name);
+  return Extension.empty() || Extension == ".h" || Extension == ".hh" ||
+         Extension == ".hpp" || Extension == ".hxx";
+}
+
+// Keywords that can come right before the tokens names are recognized by.
+bool isKeyword(StringRef Identifier) {
+  static const char *const Keywords[] = {
+    "alignof", "auto", "bool", "char", "class", "const", "constexpr",
+    "decltype", "default", "delete", "double", "enum", "explicit", "extern",
+    "false", "final", "float", "inline", "int", "long", "mutable", "noexcept",
+    "nullptr", "operator", "override", "private", "protected", "public",
+    "return", "short", "signed", "sizeof", "static", "static_assert", "struct",
+    "template", "this", "throw", "true", "typedef", "typename", "union",
+    "unsigned", "using", "virtual", "void", "volatile"
+  };
+  return std::find(std::begin(Keywords), std::end(Keywords), Identifier) !=
+         std::end(Keywords);
+}
+
+bool isMacroLike(StringRef Identifier) {
+  for (char C : Identifier) {
+    if (!(isupper(C) || isdigit(C) || C == '_'))
+      return false;
+  }
+  return true;
+}
+
+// Lexes Buffer without preprocessing it. This errs on the side of finding
+// too many names: a false conflict only costs a smaller batch.
+FileScan scanFile(StringRef Buffer) {
+  FileScan Scan;
+  Scan.Lines = Buffer.count('\n');
+
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = 1;
+  LangOpts.CPlusPlus11 = 1;
+  Lexer Lex(SourceLocation(), LangOpts, Buffer.begin(), Buffer.begin(),
+            Buffer.end());
+
+  // Whether each open brace is a namespace or linkage block, whose contents
+  // are still at file scope.
+  std::vector<bool> Braces;
+  unsigned Depth = 0, Parens = 0, Angles = 0;
+  bool NamespaceBrace = false, SkipToBrace = false;
+  bool SawDefine = false, LastIncludeAfterDefine = false;
+  // A macro invocation at file scope, e.g. Q_DECLARE_METATYPE(T), whose
+  // arguments are collected as names.
+  unsigned MacroArgs = 0;
+  Token Prev, PrevPrev;
+  Prev.startToken();
+  PrevPrev.startToken();
+
+  Token Tok;
+  Lex.LexFromRawLexer(Tok);
+  while (Tok.isNot(tok::eof)) {
+    if (Tok.is(tok::hash) && Tok.isAtStartOfLine()) {
+      Lex.LexFromRawLexer(Tok);
+      if (Tok.is(tok::raw_identifier)) {
+        StringRef Directive = Tok.getRawIdentifier();
+        if (Directive == "define" || Directive == "undef") {
+          Lex.LexFromRawLexer(Tok);
+          if (Tok.is(tok::raw_identifier) && !Tok.isAtStartOfLine()) {
+            Scan.Macros.insert(Tok.getRawIdentifier().str());
+            SawDefine = true;
+          }
+        } else if (Directive == "include" || Directive == "import" ||
+                   Directive == "include_next") {
+          StringRef Rest(Lex.getBufferLocation(), Buffer.end() - Lex.getBufferLocation());
+          Rest = Rest.substr(0, Rest.find('\n')).trim();
+          StringRef Name = Rest.size() > 2 ? Rest.substr(1).split(Rest[0] == '<' ? '>' : '"').first : StringRef();
+          if (!isHeader(Name))
+            Scan.Eligible = false;
+          LastIncludeAfterDefine = SawDefine;
+        }
+      }
+      // Skip the rest of the directive, but keep the identifiers in it.
+      while (Tok.isNot(tok::eof) && !Tok.isAtStartOfLine()) {
+        if (Tok.is(tok::raw_identifier))
+          Scan.Identifiers.insert(Tok.getRawIdentifier().str());
+        Lex.LexFromRawLexer(Tok);
+      }
+      continue;
+    }
+
+    bool FileScope = Depth == 0 && Parens == 0 && Angles == 0 && !SkipToBrace;
+    switch (Tok.getKind()) {
+    case tok::raw_identifier: {
+      StringRef Identifier = Tok.getRawIdentifier();
+      Scan.Identifiers.insert(Identifier.str());
+      if (Identifier == "namespace") {
+        NamespaceBrace = true;
+        if (Prev.is(tok::raw_identifier) && Prev.getRawIdentifier() == "using" && Depth == 0)
+          Scan.Eligible = false;
+      }
+      if (MacroArgs && !isKeyword(Identifier))
+        Scan.Names.insert(Identifier.str());
+      break;
+    }
+    case tok::string_literal:
+      // extern "C" {
+      if (Prev.is(tok::raw_identifier) && Prev.getRawIdentifier() == "extern")
+        NamespaceBrace = true;
+      break;
+    case tok::l_brace:
+      Braces.push_back(NamespaceBrace);
+      if (!NamespaceBrace)
+        ++Depth;
+      NamespaceBrace = SkipToBrace = false;
+      break;
+    case tok::r_brace:
+      if (!Braces.empty()) {
+        if (!Braces.back() && Depth)
+          --Depth;
+        Braces.pop_back();
+      }
+      break;
+    case tok::l_paren:
+      if (MacroArgs)
+        ++MacroArgs;
+      else if (FileScope && Prev.is(tok::raw_identifier) && isMacroLike(Prev.getRawIdentifier()))
+        MacroArgs = 1;
+      ++Parens;
+      break;
+    case tok::r_paren:
+      if (MacroArgs)
+        --MacroArgs;
+      if (Parens)
+        --Parens;
+      break;
+    case tok::less:
+      if (Prev.is(tok::raw_identifier))
+        ++Angles;
+      break;
+    case tok::greater:
+      if (Angles)
+        --Angles;
+      break;
+    case tok::greatergreater:
+      Angles = Angles > 2 ? Angles - 2 : 0;
+      break;
+    case tok::colon:
+      // Foo::Foo() : Member(...) {
+      if (Prev.is(tok::r_paren) && Depth == 0)
+        SkipToBrace = true;
+      break;
+    case tok::semi:
+      NamespaceBrace = SkipToBrace = false;
+      Parens = Angles = MacroArgs = 0;
+      break;
+    default:
+      break;
+    }
+
+    // The name in "T name(", "T name =", "T name;", "class Name {" ...
+    if (FileScope && Prev.is(tok::raw_identifier) &&
+        Tok.isOneOf(tok::l_paren, tok::equal, tok::semi, tok::l_square,
+                    tok::comma, tok::l_brace, tok::colon) &&
+        !isKeyword(Prev.getRawIdentifier()) &&
+        !isMacroLike(Prev.getRawIdentifier()) &&
+        !PrevPrev.isOneOf(tok::coloncolon, tok::period, tok::arrow, tok::tilde)) {
+      // Forward declarations may be repeated.
+      bool Forward = Tok.is(tok::semi) && PrevPrev.is(tok::raw_identifier) &&
+                     (PrevPrev.getRawIdentifier() == "class" ||
+                      PrevPrev.getRawIdentifier() == "struct");
+      if (!Forward)
+        Scan.Names.insert(Prev.getRawIdentifier().str());
+    }
+
+    PrevPrev = Prev;
+    Prev = Tok;
+    Lex.LexFromRawLexer(Tok);
+  }
+
+  if (LastIncludeAfterDefine)
+    Scan.Eligible = false;
+  return Scan;
+}
+
+bool intersects(const std::set<std::string> &A, const std::set<std::string> &B) {
+  const std::set<std::string> &Small = A.size() < B.size() ? A : B;
+  const std::set<std::string> &Large = A.size() < B.size() ? B : A;
+  for (const std::string &Name : Small) {
+    if (Large.count(Name))
+      return true;
+  }
+  return false;
+}
+
+struct Batch {
+  CompileCommand Command;
+  std::vector<std::string> Files;
+  std::vector<FileScan> Scans;
+
+  bool accepts(const FileScan &Scan) const {
+    for (const FileScan &Member : Scans) {
+      if (intersects(Scan.Names, Member.Names) ||
+          intersects(Scan.Macros, Member.Identifiers) ||
+          intersects(Member.Macros, Scan.Identifiers))
+        return false;
+    }
+    return true;
+  }
+};
+
+std::string absolutePath(const CompileCommand &Command) {
+  SmallString<256> Path(Command.Filename);
+  if (!sys::path::is_absolute(Path)) {
+    Path = Command.Directory;
+    sys::path::append(Path, Command.Filename);
+  }
+  sys::path::remove_dots(Path, true);
+  return Path.str().str();
+}
+
+// The command line of Command without the source file and output, so that
+// TUs compiled the same way get the same key.
+std::string commandKey(const CompileCommand &Command) {
+  std::string Key = Command.Directory;
+  const std::vector<std::string> &Args = Command.CommandLine;
+  for (size_t I = 0; I < Args.size(); ++I) {
+    if (Args[I] == "-o") {
+      ++I;
+      continue;
+    }
+    if (Args[I] == Command.Filename || StringRef(Args[I]).startswith("-o"))
+      continue;
+    Key += '\0';
+    Key += Args[I];
+  }
+  return Key;
+}
+
+// Answers for the synthetic unity files and forwards everything else.
+class UnityDatabase : public tooling::CompilationDatabase {
+ public:
+  UnityDatabase(const tooling::CompilationDatabase &Inner) : Inner(Inner) {}
+
+  void add(const std::string &File, const CompileCommand &Command) {
+    Commands[File] = Command;
+  }
+
+  virtual std::vector<CompileCommand> getCompileCommands(StringRef FilePath) const {
+    std::map<std::string, CompileCommand>::const_iterator I = Commands.find(FilePath.str());
+    if (I != Commands.end())
+      return std::vector<CompileCommand>(1, I->second);
+    return Inner.getCompileCommands(FilePath);
+  }
+  virtual std::vector<std::string> getAllFiles() const { return Inner.getAllFiles(); }
+  virtual std::vector<CompileCommand> getAllCompileCommands() const {
+    return Inner.getAllCompileCommands();
+  }
+
+ private:
+  const tooling::CompilationDatabase &Inner;
+  std::map<std::string, CompileCommand> Commands;
+};
+} // end namespace
+
+int runUnity(const tooling::CompilationDatabase &Compilations,
+             const std::vector<std::string> &Files, const UnityOptions &Options,
+             tooling::FrontendActionFactory &Factory, raw_ostream &Report) {
+  std::vector<std::string> Alone;
+  std::map<std::string, std::vector<Batch> > Groups;
+  std::vector<std::string> Keys;
+  {
+    Trace::Scope Span("Unity grouping");
+    for (const std::string &File : Files) {
+      std::vector<CompileCommand> Commands = Compilations.getCompileCommands(File);
+      ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer = MemoryBuffer::getFile(File);
+      if (Commands.size() != 1 || !Buffer) {
+        Alone.push_back(File);
+        continue;
+      }
+      FileScan Scan = scanFile((*Buffer)->getBuffer());
+      if (!Scan.Eligible || Scan.Lines > Options.MaxLines) {
+        Alone.push_back(File);
+        continue;
+      }
+
+      std::string Key = commandKey(Commands.front());
+      std::vector<Batch> &Batches = Groups[Key];
+      if (Batches.empty())
+        Keys.push_back(Key);
+      std::vector<Batch>::iterator Target = Batches.begin();
+      while (Target != Batches.end() &&
+             (Target->Files.size() >= Options.MaxBatchSize || !Target->accepts(Scan)))
+        ++Target;
+      if (Target == Batches.end()) {
+        Batches.push_back(Batch());
+        Target = Batches.end() - 1;
+        Target->Command = Commands.front();
+      }
+      Target->Files.push_back(File);
+      Target->Scans.push_back(Scan);
+    }
+  }
+
+  UnityDatabase Database(Compilations);
+  unsigned Batched = 0, BatchCount = 0, Failed = 0;
+  for (const std::string &Key : Keys) {
+    for (Batch &B : Groups[Key]) {
+      if (B.Files.size() == 1) {
+        Alone.push_back(B.Files.front());
+        continue;
+      }
+
+      // Undefine each TU's macros so that they cannot leak into the next.
+      std::string Content = "// qt4to5 unity batch\n";
+      for (size_t I = 0; I < B.Files.size(); ++I) {
+        CompileCommand Member = B.Command;
+        Member.Filename = B.Files[I];
+        Content += "#include \"" + absolutePath(Member) + "\"\n";
+        for (const std::string &Macro : B.Scans[I].Macros)
+          Content += "#undef " + Macro + "\n";
+      }
+
+      SmallString<256> Path(B.Command.Directory);
+      sys::path::append(Path, "qt4to5-unity-" + std::to_string(BatchCount++) + ".cpp");
+      CompileCommand Command = B.Command;
+      for (std::string &Arg : Command.CommandLine) {
+        if (Arg == B.Command.Filename)
+          Arg = Path.str().str();
+      }
+      Command.Filename = Path.str().str();
+      Database.add(Command.Filename, Command);
+
+      Trace::Scope Span("Unity batch", Path);
+      size_t Staged = Utils::StagedReplacements().size();
+      IgnoringDiagConsumer Quiet;
+      tooling::ClangTool Tool(Database, std::vector<std::string>(1, Command.Filename));
+      Tool.mapVirtualFile(Path, Content);
+      Tool.setDiagnosticConsumer(&Quiet);
+      if (Options.Adjuster)
+        Tool.appendArgumentsAdjuster(Options.Adjuster);
+      if (Tool.run(&Factory) == 0) {
+        Batched += B.Files.size();
+        continue;
+      }
+      // -diff may already have taken (and dropped) what the batch staged.
+      if (Utils::StagedReplacements().size() > Staged)
+        Utils::StagedReplacements().erase(Utils::StagedReplacements().begin() + Staged,
+                                          Utils::StagedReplacements().end());
+      ++Failed;
+      Alone.insert(Alone.end(), B.Files.begin(), B.Files.end());
+    }
+  }
+
+  Report << "unity: " << Batched << " of " << Files.size() << " TUs in "
+         << BatchCount - Failed << " batches, " << Failed
+         << " batches failed and were ported TU by TU\n";
+
+  if (Alone.empty())
+    return 0;
+  std::sort(Alone.begin(), Alone.end());
+  tooling::ClangTool Tool(Compilations, Alone);
+  if (Options.Adjuster)
+    Tool.appendArgumentsAdjuster(Options.Adjuster);
+  return Tool.run(&Factory);
+}
@@ -0,0 +1,48 @@
+//===- Unity.h - Parsing small TUs together in unity batches --------------===//
+//
+//  Small TUs spend nearly all of their parse time in the same Qt headers.
+//  With -unity, TUs below a size limit that share a compile command are
+//  grouped into synthetic TUs that #include them one after another, so the
+//  headers are parsed once per batch instead of once per TU. The synthetic
+//  files only exist in the tool's virtual file system; the sources are
+//  included by path, so every replacement already points into the original
+//  file.
+//
+//  A quick lexical scan keeps apart TUs that would interfere: ones that
+//  define file-scope names the other also defines, ones that use a macro the
+//  other defines, and ones that define macros before their last #include or
+//  include anything but headers. A batch that still fails to parse is
+//  discarded and its TUs are ported one by one.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_UNITY_H
+#define QT4TO5_UNITY_H
+
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/raw_ostream.h"
+
+struct UnityOptions {
+  UnityOptions() : MaxLines(200), MaxBatchSize(32) {}
+
+  // TUs with more lines than this are always ported alone.
+  unsigned MaxLines;
+  unsigned MaxBatchSize;
+  // Applied to every command after ClangTool's own adjusters, if set.
+  clang::tooling::ArgumentsAdjuster Adjuster;
+};
+
+// Runs Factory over Files, batching the ones that can be batched. The
+// replacements a failing batch staged are discarded. Writes a summary to
+// Report and returns non-zero if a TU failed on its own.
+int runUnity(const clang::tooling::CompilationDatabase &Compilations,
+             const std::vector<std::string> &Files, const UnityOptions &Options,
+             clang::tooling::FrontendActionFactory &Factory,
+             llvm::raw_ostream &Report);
+
+#endif
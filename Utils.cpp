@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <string>
 
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "clang/Basic/FileManager.h"
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/Tooling.h"
 
+#include "Memory.h"
+#include "Probes.h"
 #include "Utils.h"
 
 namespace Utils {
@@ -10,19 +17,116 @@ namespace Utils {
     using namespace llvm;
     using clang::tooling::Replacements;
     using clang::tooling::Replacement;
-    
-    llvm::Error AddReplacement(const FileEntry* Entry, const Replacement &replacement, std::map<std::string, Replacements> *replacementMap){        
-        StringRef FileName = Entry->getName();
 
-        if( replacementMap->count(FileName) > 0){
-            return replacementMap->find(FileName)->second.add(replacement);
+    static std::map<std::string, std::set<std::string> > RulesByFile;
+
+    static std::vector<StagedReplacement> Staged;
+
+    llvm::Error AddReplacement(const FileEntry* Entry, const Replacement &replacement, std::map<std::string, Replacements> *replacementMap,
+                               bool Ifdef){        
+        QT4TO5_PROBE4(replacement__add, Probes::currentRule(), replacement.getFilePath().data(),
+                      replacement.getOffset(), replacement.getLength());
+
+        if (*Probes::currentRule())
+            RulesByFile[replacement.getFilePath()].insert(Probes::currentRule());
+
+        StagedReplacement Pending = { replacement, replacementMap, Probes::currentRule(), Ifdef, false };
+        Staged.push_back(Pending);
+
+        // What the entry holds, not what growing the staging vector happened
+        // to allocate in this call.
+        if (Memory::enabled())
+            Memory::addReplacement(Probes::currentRule(),
+                                   sizeof(StagedReplacement) + replacement.getFilePath().size() +
+                                   replacement.getReplacementText().size());
+        return llvm::Error::success();
+    }
+
+    std::vector<StagedReplacement> &StagedReplacements(){
+        return Staged;
+    }
+
+    unsigned MergeStaged(const std::vector<std::string> &RuleOrder, raw_ostream &Errors,
+                         std::vector<RankedReplacement> *Accepted){
+        std::map<std::map<std::string, Replacements> *, std::vector<RankedReplacement> > ByTarget;
+        for (const StagedReplacement &S : Staged) {
+            unsigned Priority = std::find(RuleOrder.begin(), RuleOrder.end(), S.Rule) - RuleOrder.begin();
+            RankedReplacement Ranked = { S.Fix, Priority, S.Rule, S.Ifdef, S.Guarded };
+            ByTarget[S.Target].push_back(Ranked);
         }
-        else {
-            replacementMap->insert(std::pair<std::string, Replacements>(FileName, Replacements(replacement)));
+        Staged.clear();
+
+        unsigned Dropped = 0;
+        for (auto &Target : ByTarget)
+            Dropped += MergeReplacements(std::move(Target.second), *Target.first, Errors, Accepted);
+        return Dropped;
+    }
+
+    unsigned MergeReplacements(std::vector<RankedReplacement> Fixes,
+                               std::map<std::string, Replacements> &Merged, raw_ostream &Errors,
+                               std::vector<RankedReplacement> *Accepted){
+        std::sort(Fixes.begin(), Fixes.end(),
+                  [](const RankedReplacement &A, const RankedReplacement &B) {
+            const Replacement &L = A.Fix, &R = B.Fix;
+            if (L.getFilePath() != R.getFilePath())
+                return L.getFilePath() < R.getFilePath();
+            if (L.getOffset() != R.getOffset())
+                return L.getOffset() < R.getOffset();
+            if (L.getLength() != R.getLength())
+                return L.getLength() < R.getLength();
+            if (A.Priority != B.Priority)
+                return A.Priority < B.Priority;
+            return L.getReplacementText() < R.getReplacementText();
+        });
+
+        // Fixes of different rules at one range are sorted by rule, so a
+        // duplicate need not be next to the entry it repeats; compare against
+        // everything accepted at that range.
+        unsigned Dropped = 0;
+        std::vector<const Replacement *> SameRange;
+        for (const RankedReplacement &Ranked : Fixes) {
+            const Replacement &Fix = Ranked.Fix;
+            if (!SameRange.empty() && (SameRange.front()->getFilePath() != Fix.getFilePath() ||
+                                       SameRange.front()->getOffset() != Fix.getOffset() ||
+                                       SameRange.front()->getLength() != Fix.getLength()))
+                SameRange.clear();
+            if (std::any_of(SameRange.begin(), SameRange.end(),
+                            [&](const Replacement *R) { return *R == Fix; }))
+                continue;
+            SameRange.push_back(&Fix);
+            if (llvm::Error Err = Merged[Fix.getFilePath()].add(Fix)) {
+                Errors << "Skipping conflicting replacement " << Fix.toString()
+                       << ": " << llvm::toString(std::move(Err)) << "\n";
+                ++Dropped;
+            } else if (Accepted) {
+                Accepted->push_back(Ranked);
+            }
         }
+        return Dropped;
+    }
 
-        return llvm::Error::success();
+    const std::map<std::string, std::set<std::string> > &ReplacementRules(){
+        return RulesByFile;
+    }
+
+    std::string NormalizePath(StringRef Path){
+        SmallString<256> Absolute(Path);
+        sys::fs::make_absolute(Absolute);
+        sys::path::remove_dots(Absolute, true);
+        return Absolute.str().str();
     }
 
-    
-}
\ No newline at end of file
+    bool RunOnCommand(const tooling::CompileCommand &Command, FrontendAction *Action,
+                      const tooling::ArgumentsAdjuster &Adjuster, DiagnosticConsumer *Diagnostics){
+        // ClangTool chdir()s into the command's directory; resolve relative
+        // paths through the FileManager instead.
+        FileSystemOptions Options;
+        Options.WorkingDir = Command.Directory;
+        IntrusiveRefCntPtr<FileManager> Files(new FileManager(Options));
+
+        tooling::ToolInvocation Invocation(Adjuster(Command.CommandLine, Command.Filename), Action, Files.get());
+        if (Diagnostics)
+            Invocation.setDiagnosticConsumer(Diagnostics);
+        return Invocation.run();
+    }
+}
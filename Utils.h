@@ -1,11 +1,82 @@
+#ifndef QT4TO5_UTILS_H
+#define QT4TO5_UTILS_H
+
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace Utils {
     using namespace clang;
     using clang::tooling::Replacements;
     using clang::tooling::Replacement;
     
-    llvm::Error AddReplacement(const FileEntry* Entry, const Replacement &replacement, std::map<std::string, Replacements> *replacementMap);
-}
\ No newline at end of file
+    // Stages replacement for replacementMap. Staged replacements only reach
+    // their maps through MergeStaged, so that the order in which TUs are
+    // processed cannot decide which of two conflicting replacements is kept.
+    // Ifdef marks the #if/#endif lines of -create-ifdefs.
+    llvm::Error AddReplacement(const FileEntry* Entry, const Replacement &replacement, std::map<std::string, Replacements> *replacementMap,
+                               bool Ifdef = false);
+
+    struct StagedReplacement {
+        Replacement Fix;
+        std::map<std::string, Replacements> *Target;
+        // The rule that made it (a RuleCallback id), or "".
+        const char *Rule;
+        bool Ifdef;
+        // Made by a match that also created an #if.
+        bool Guarded;
+    };
+
+    std::vector<StagedReplacement> &StagedReplacements();
+
+    // A replacement on its way into a replacement map, with the rule that
+    // made it. Fixes files keep both, so that shards and workers merge in
+    // the same order as a single process.
+    struct RankedReplacement {
+        Replacement Fix;
+        // Position of Rule in the rule order; the lower one wins conflicts.
+        unsigned Priority;
+        // The rule that made it (a RuleCallback id), or "".
+        std::string Rule;
+        // As in StagedReplacement.
+        bool Ifdef;
+        bool Guarded;
+    };
+
+    // Adds the staged replacements to their maps, ranking rules by their
+    // position in RuleOrder. See MergeReplacements.
+    unsigned MergeStaged(const std::vector<std::string> &RuleOrder, llvm::raw_ostream &Errors,
+                         std::vector<RankedReplacement> *Accepted = nullptr);
+
+    // Adds Fixes to Merged in canonical order: by file, offset and length,
+    // then by priority (lower first) and text. Identical replacements are
+    // kept once; of conflicting ones the first in that order is kept and
+    // the others are reported. Appends what was added to Accepted, in that
+    // order. Returns how many were dropped.
+    unsigned MergeReplacements(std::vector<RankedReplacement> Fixes,
+                               std::map<std::string, Replacements> &Merged, llvm::raw_ostream &Errors,
+                               std::vector<RankedReplacement> *Accepted = nullptr);
+
+    // The rules that added replacements to each file, keyed like the
+    // replacement maps. Rules running in the same MatchFinder share a map, so
+    // this is what tells them apart afterwards.
+    const std::map<std::string, std::set<std::string> > &ReplacementRules();
+
+    // Makes Path absolute against the current directory and strips "." and
+    // ".." components so that names from different TUs can be compared.
+    std::string NormalizePath(llvm::StringRef Path);
+
+    // Runs Action over a single compile command without touching the process
+    // working directory, so it can be used from several threads at once.
+    // Takes ownership of Action.
+    bool RunOnCommand(const tooling::CompileCommand &Command, FrontendAction *Action,
+                      const tooling::ArgumentsAdjuster &Adjuster, DiagnosticConsumer *Diagnostics);
+}
+
+#endif
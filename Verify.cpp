@@ -0,0 +1,127 @@
+#include "Verify.h"
+
+#include <mutex>
+
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "Trace.h"
+#include "Utils.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace {
+struct Check {
+  std::string TU;
+  const char *Target;
+  std::vector<std::string> IncludePaths;
+  bool Passed;
+  std::string Diagnostics;
+};
+
+void runCheck(const tooling::CompilationDatabase &Compilations, Check &C) {
+  Trace::Scope Span(std::string("Syntax check against ") + C.Target, C.TU);
+
+  tooling::CommandLineArguments Extra;
+  for (const std::string &Path : C.IncludePaths)
+    Extra.push_back("-I" + Path);
+
+  tooling::ArgumentsAdjuster Adjuster = tooling::combineAdjusters(
+      tooling::combineAdjusters(tooling::getClangStripOutputAdjuster(),
+                                tooling::getClangSyntaxOnlyAdjuster()),
+      tooling::getInsertArgumentAdjuster(
+          Extra, tooling::ArgumentInsertPosition::BEGIN));
+
+  raw_string_ostream OS(C.Diagnostics);
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
+  TextDiagnosticPrinter Printer(OS, DiagOpts.get());
+
+  C.Passed = true;
+  for (const tooling::CompileCommand &Command :
+       Compilations.getCompileCommands(C.TU)) {
+    if (!Utils::RunOnCommand(Command, new SyntaxOnlyAction, Adjuster, &Printer))
+      C.Passed = false;
+  }
+  OS.flush();
+}
+
+// Returns the rules whose rewritten files end up in TU.
+std::set<std::string> rulesAffecting(const IncludeGraph &Graph,
+                                     const RewrittenFiles &Files,
+                                     const std::string &TU) {
+  std::set<std::string> Rules;
+  const IncludeGraph::TranslationUnit *Info = Graph.lookup(TU);
+  if (!Info)
+    return Rules;
+  for (const auto &File : Files) {
+    if (Info->Files.count(File.first))
+      Rules.insert(File.second.begin(), File.second.end());
+  }
+  return Rules;
+}
+} // end namespace
+
+bool verifyRewrittenFiles(const tooling::CompilationDatabase &Compilations,
+                          const IncludeGraph &Graph, const RewrittenFiles &Files,
+                          const VerifyOptions &Options, raw_ostream &OS) {
+  std::set<std::string> Names;
+  for (const auto &File : Files)
+    Names.insert(File.first);
+  std::vector<std::string> TUs = Graph.affectedBy(Names);
+
+  OS << "verify: " << Files.size() << " rewritten files affect " << TUs.size()
+     << " TUs\n";
+
+  std::vector<Check> Checks;
+  for (const std::string &TU : TUs) {
+    Check C;
+    C.TU = TU;
+    C.Target = "Qt 5";
+    C.IncludePaths = Options.Qt5IncludePaths;
+    C.Passed = false;
+    Checks.push_back(C);
+    if (Options.CheckQt4) {
+      C.Target = "Qt 4";
+      C.IncludePaths = Options.Qt4IncludePaths;
+      Checks.push_back(C);
+    }
+  }
+
+  {
+    ThreadPool Pool(Options.Jobs);
+    for (Check &C : Checks)
+      Pool.async([&Compilations, &C] { runCheck(Compilations, C); });
+    Pool.wait();
+  }
+
+  // Rule -> (checked TUs, failed TUs).
+  std::map<std::string, std::pair<unsigned, unsigned> > Summary;
+  bool AllPassed = true;
+  for (const Check &C : Checks) {
+    std::set<std::string> Rules = rulesAffecting(Graph, Files, C.TU);
+    for (const std::string &Rule : Rules) {
+      ++Summary[Rule].first;
+      if (!C.Passed)
+        ++Summary[Rule].second;
+    }
+    if (C.Passed)
+      continue;
+
+    AllPassed = false;
+    OS << "verify: error: " << C.TU << " does not compile against " << C.Target
+       << " (rules:";
+    for (const std::string &Rule : Rules)
+      OS << " " << Rule;
+    OS << ")\n" << C.Diagnostics;
+  }
+
+  for (const auto &Rule : Summary)
+    OS << "verify: " << Rule.first << ": " << Rule.second.second << " of "
+       << Rule.second.first << " checks failed\n";
+
+  return AllPassed;
+}
@@ -0,0 +1,44 @@
+//===- Verify.h - Syntax-check the TUs touched by a porting step ----------===//
+//
+//  After a porting step has written its replacements, every translation unit
+//  that is, or includes, a rewritten file is syntax-checked against the Qt 5
+//  headers (and, if ifdefs were created, against Qt 4 as well). Failures are
+//  reported per rule so that a bad rewrite can be found without a full
+//  build.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_VERIFY_H
+#define QT4TO5_VERIFY_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "IncludeGraph.h"
+
+struct VerifyOptions {
+  VerifyOptions() : CheckQt4(false), Jobs(0) {}
+
+  // Prepended as -I to every command when checking against Qt 5/Qt 4. An
+  // empty list checks against the include paths of the compile command.
+  std::vector<std::string> Qt5IncludePaths;
+  std::vector<std::string> Qt4IncludePaths;
+  // Set when the rewrite created QT_VERSION ifdefs, so the old branch has to
+  // keep compiling too.
+  bool CheckQt4;
+  unsigned Jobs;
+};
+
+// Syntax-checks every TU in Graph affected by Files and writes a per-rule
+// report to OS. Returns true if all of them compiled.
+bool verifyRewrittenFiles(
+    const clang::tooling::CompilationDatabase &Compilations,
+    const IncludeGraph &Graph, const RewrittenFiles &Files,
+    const VerifyOptions &Options, llvm::raw_ostream &OS);
+
+#endif
@@ -0,0 +1,224 @@
+#include "Watchdog.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <thread>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "Fixes.h"
+#include "Memory.h"
+#include "Trace.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace {
+enum Outcome {
+  Completed,   // Exited with 0.
+  Errors,      // Exited non-zero, e.g. because of compile errors.
+  OverBudget,  // Killed by the timeout, the memory limit or a crash.
+  NotStarted
+};
+
+struct Attempt {
+  Attempt() : Result(NotStarted), Seconds(0), PeakRSS(0) {}
+
+  Outcome Result;
+  double Seconds;
+  // Of the worker process, in bytes.
+  uint64_t PeakRSS;
+  std::string Message;
+};
+
+struct TUResult {
+  std::vector<Attempt> Attempts;
+  std::vector<Utils::RankedReplacement> Fixes;
+  bool HasFixes;
+};
+
+Attempt runWorker(const WorkerOptions &Options, const std::string &TU,
+                  bool Reduced, std::vector<Utils::RankedReplacement> &Fixes,
+                  bool &HasFixes) {
+  Attempt A;
+  SmallString<128> FixesPath;
+  if (std::error_code EC =
+          sys::fs::createTemporaryFile("qt4to5-worker", "yaml", FixesPath)) {
+    A.Message = EC.message();
+    return A;
+  }
+
+  std::vector<std::string> Args = Options.Args;
+  Args.push_back("-worker-fixes=" + FixesPath.str().str());
+  if (Reduced)
+    Args.push_back("-reduced-parse");
+  Args.push_back(TU);
+  std::vector<const char *> Argv;
+  for (const std::string &Arg : Args)
+    Argv.push_back(Arg.c_str());
+  Argv.push_back(nullptr);
+
+  std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+  std::string ErrMsg;
+  bool ExecutionFailed = false;
+  sys::ProcessInfo Child =
+      sys::ExecuteNoWait(Options.Program, Argv.data(), nullptr, nullptr,
+                         Options.MemoryLimitMB, &ErrMsg, &ExecutionFailed);
+  if (ExecutionFailed) {
+    A.Message = ErrMsg;
+    sys::fs::remove(FixesPath);
+    return A;
+  }
+
+  // Poll with wait4() instead of sys::Wait: its timeout uses a
+  // process-wide alarm that cannot be shared between worker threads, and it
+  // does not return the worker's resource usage.
+  bool TimedOut = false;
+  int Status = 0;
+  struct rusage Usage;
+  memset(&Usage, 0, sizeof(Usage));
+  for (;;) {
+    pid_t Done = ::wait4(Child.Pid, &Status, WNOHANG, &Usage);
+    if (Done == Child.Pid)
+      break;
+    if (Done < 0 && errno != EINTR) {
+      A.Message = std::string("wait4: ") + strerror(errno);
+      break;
+    }
+    A.Seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - Start).count();
+    if (Options.TimeoutSeconds && A.Seconds >= Options.TimeoutSeconds) {
+      ::kill(Child.Pid, SIGKILL);
+      while (::wait4(Child.Pid, &Status, 0, &Usage) < 0 && errno == EINTR) {
+      }
+      TimedOut = true;
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  A.Seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - Start).count();
+  // ru_maxrss is in kilobytes on Linux.
+  A.PeakRSS = uint64_t(Usage.ru_maxrss) * 1024;
+
+  if (TimedOut) {
+    A.Result = OverBudget;
+    A.Message = "timed out";
+  } else if (!A.Message.empty()) {
+    A.Result = OverBudget;
+  } else if (WIFEXITED(Status) && WEXITSTATUS(Status) == 0) {
+    A.Result = Completed;
+  } else if (WIFSIGNALED(Status)) {
+    A.Result = OverBudget;
+    A.Message = std::string("killed by ") + strsignal(WTERMSIG(Status));
+  } else {
+    A.Result = Errors;
+    A.Message = "exited with " + std::to_string(WEXITSTATUS(Status));
+  }
+
+  // A worker that stopped on compile errors still wrote what it matched in
+  // the code that parsed, as the in-process run keeps it too.
+  if (A.Result == Completed || A.Result == Errors) {
+    std::string Ignored;
+    raw_string_ostream IgnoredErrors(Ignored);
+    HasFixes = readFixes(FixesPath, Fixes, IgnoredErrors);
+  }
+  sys::fs::remove(FixesPath);
+  sys::fs::remove(FixesPath + ".partial");
+  return A;
+}
+
+const char *describe(Outcome Result) {
+  switch (Result) {
+  case Completed: return "completed";
+  case Errors: return "failed";
+  case OverBudget: return "over budget";
+  case NotStarted: return "could not start";
+  }
+  return "";
+}
+} // end namespace
+
+bool runWorkers(const std::vector<std::string> &TUs,
+                const WorkerOptions &Options,
+                std::map<std::string, Replacements> &Merged,
+                std::vector<Utils::RankedReplacement> &Accepted,
+                raw_ostream &Report) {
+  std::vector<TUResult> Results(TUs.size());
+  {
+    ThreadPool Pool(Options.Jobs);
+    for (size_t I = 0; I < TUs.size(); ++I) {
+      Pool.async([&, I] {
+        Trace::Scope Span("Worker", TUs[I]);
+        TUResult &R = Results[I];
+        R.HasFixes = false;
+        R.Attempts.push_back(runWorker(Options, TUs[I], false, R.Fixes, R.HasFixes));
+        if (R.Attempts.back().Result == OverBudget) {
+          Trace::Scope Retry("Worker (reduced parse)", TUs[I]);
+          R.Fixes.clear();
+          R.Attempts.push_back(runWorker(Options, TUs[I], true, R.Fixes, R.HasFixes));
+        }
+      });
+    }
+    Pool.wait();
+  }
+
+  std::vector<Utils::RankedReplacement> Fixes;
+  unsigned Retried = 0, Salvaged = 0, Failed = 0;
+  size_t Slowest = 0, Largest = 0;
+  for (size_t I = 0; I < TUs.size(); ++I) {
+    const TUResult &R = Results[I];
+    const Attempt &Last = R.Attempts.back();
+    if (Last.Seconds > Results[Slowest].Attempts.back().Seconds)
+      Slowest = I;
+    if (Last.PeakRSS > Results[Largest].Attempts.back().PeakRSS)
+      Largest = I;
+    if (R.Attempts.size() > 1)
+      ++Retried;
+    if (R.HasFixes) {
+      Fixes.insert(Fixes.end(), R.Fixes.begin(), R.Fixes.end());
+      if (R.Attempts.size() > 1)
+        ++Salvaged;
+    } else {
+      ++Failed;
+    }
+    if (R.Attempts.size() == 1 && Last.Result == Completed)
+      continue;
+
+    for (size_t N = 0; N < R.Attempts.size(); ++N) {
+      const Attempt &A = R.Attempts[N];
+      Report << "watchdog: " << TUs[I] << ": "
+             << (N ? "reduced parse " : "") << describe(A.Result) << " after "
+             << format("%.1f", A.Seconds) << " s, peak RSS "
+             << Memory::formatBytes(A.PeakRSS);
+      if (!A.Message.empty())
+        Report << " (" << A.Message << ")";
+      Report << "\n";
+    }
+    Report << "watchdog: " << TUs[I] << ": "
+           << (R.HasFixes ? "results kept" : "no results") << "\n";
+  }
+
+  Utils::MergeReplacements(std::move(Fixes), Merged, Report, &Accepted);
+  Report << "watchdog: " << TUs.size() << " TUs, " << Retried
+         << " over budget, " << Salvaged << " salvaged with a reduced parse, "
+         << Failed << " without results\n";
+  if (!TUs.empty()) {
+    const Attempt &Slow = Results[Slowest].Attempts.back();
+    const Attempt &Large = Results[Largest].Attempts.back();
+    Report << "watchdog: slowest " << TUs[Slowest] << " ("
+           << format("%.1f", Slow.Seconds) << " s), largest " << TUs[Largest]
+           << " (peak RSS " << Memory::formatBytes(Large.PeakRSS) << ")\n";
+  }
+  return Failed == 0;
+}
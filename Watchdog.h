@@ -0,0 +1,49 @@
+//===- Watchdog.h - Porting TUs in worker processes under a budget --------===//
+//
+//  With -tu-timeout or -tu-memory-limit, each TU is ported by a worker
+//  process of its own (qt4to5 invoked with -worker-fixes) so that one that
+//  runs over its time or memory budget can be killed without losing the
+//  results of the others. A TU that is killed is retried once with
+//  -reduced-parse. What a worker matched is kept even if it stopped on
+//  compile errors. Each attempt's wall time and peak RSS are recorded.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef QT4TO5_WATCHDOG_H
+#define QT4TO5_WATCHDOG_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Utils.h"
+
+struct WorkerOptions {
+  WorkerOptions() : TimeoutSeconds(0), MemoryLimitMB(0), Jobs(1) {}
+
+  // The qt4to5 binary and the arguments every worker gets, without the TU.
+  std::string Program;
+  std::vector<std::string> Args;
+  // 0 means no limit.
+  unsigned TimeoutSeconds;
+  unsigned MemoryLimitMB;
+  unsigned Jobs;
+};
+
+// Ports every TU in a worker process, up to Options.Jobs at a time, and
+// merges the replacements of all TUs that produced results into Merged,
+// ranked by the rules that made them, appending what was merged to
+// Accepted.
+// Writes a line with the time and peak RSS of each attempt of a TU that went
+// over budget or failed, and a summary, to Report. Returns false if any TU
+// has no result in the end.
+bool runWorkers(const std::vector<std::string> &TUs,
+                const WorkerOptions &Options,
+                std::map<std::string, clang::tooling::Replacements> &Merged,
+                std::vector<Utils::RankedReplacement> &Accepted,
+                llvm::raw_ostream &Report);
+
+#endif
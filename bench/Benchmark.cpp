@@ -0,0 +1,238 @@
+//===- bench/Benchmark.cpp - Microbenchmarks for the per-match helpers ----===//
+//
+//  Measures the helpers every callback calls once per match -- getText,
+//  insertIfdef, the range computation of RemoveArgument and
+//  Utils::AddReplacement -- and Utils::MergeStaged, which every replacement
+//  goes through after the run, on synthetic in-memory sources, and reports
+//  time, allocations and allocated bytes per operation.
+//
+//  Usage:
+//  qt4to5-bench [-lines=<n>] [-files=<n>] [-passes=<n>]
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "../Memory.h"
+#include "../Probes.h"
+#include "../SourceHelpers.h"
+#include "../Utils.h"
+
+using namespace clang;
+using namespace llvm;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+cl::opt<unsigned> Lines(
+  "lines",
+  cl::desc("Number of synthetic source lines, one match per line"),
+  cl::init(20000)
+);
+
+cl::opt<unsigned> Files(
+  "files",
+  cl::desc("Number of files the lines are spread over"),
+  cl::init(8)
+);
+
+cl::opt<unsigned> Passes(
+  "passes",
+  cl::desc("Number of passes over all lines per benchmark"),
+  cl::init(20)
+);
+
+namespace {
+// Stands in for an AST node: the helpers only need its source range.
+struct Node {
+  SourceLocation Start;
+  SourceLocation End;
+
+  SourceLocation getLocStart() const { return Start; }
+  SourceLocation getLocEnd() const { return End; }
+};
+
+// One synthetic match: "  result = text(key_N, 0);"
+struct Match {
+  const FileEntry *Entry;
+  Node Call;
+  Node Key;
+  Node Arg;
+};
+
+class SyntheticSources {
+ public:
+  SyntheticSources(unsigned Lines, unsigned Files)
+      : Diagnostics(IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+                    new DiagnosticOptions(), new IgnoringDiagConsumer()),
+        FileMgr(FileSystemOptions()), Sources(Diagnostics, FileMgr) {
+    const std::string Prefix = "  result = ";
+    for (unsigned F = 0; F < Files; ++F) {
+      std::string Name = "bench" + std::to_string(F) + ".cpp";
+      std::string Text;
+      std::vector<std::pair<unsigned, unsigned> > Keys;
+      for (unsigned L = F; L < Lines; L += Files) {
+        std::string Key = "key_" + std::to_string(L);
+        unsigned Call = Text.size() + Prefix.size();
+        Text += Prefix + "text(" + Key + ", 0);\n";
+        Keys.push_back(std::make_pair(Call, Key.size()));
+      }
+
+      const FileEntry *Entry = FileMgr.getVirtualFile(Name, Text.size(), 0);
+      Sources.overrideFileContents(
+          Entry, MemoryBuffer::getMemBufferCopy(Text, Name));
+      FileID ID = Sources.createFileID(Entry, SourceLocation(), SrcMgr::C_User);
+      SourceLocation Base = Sources.getLocForStartOfFile(ID);
+
+      for (const auto &K : Keys) {
+        // text(  key_N  ,   0  )
+        unsigned KeyOffset = K.first + 5;
+        unsigned ArgOffset = KeyOffset + K.second + 2;
+        Match M;
+        M.Entry = Entry;
+        M.Call.Start = Base.getLocWithOffset(K.first);
+        M.Call.End = Base.getLocWithOffset(ArgOffset + 1);
+        M.Key.Start = M.Key.End = Base.getLocWithOffset(KeyOffset);
+        M.Arg.Start = M.Arg.End = Base.getLocWithOffset(ArgOffset);
+        Matches.push_back(M);
+      }
+    }
+  }
+
+  SourceManager &sources() { return Sources; }
+  const std::vector<Match> &matches() const { return Matches; }
+
+ private:
+  DiagnosticsEngine Diagnostics;
+  FileManager FileMgr;
+  SourceManager Sources;
+  std::vector<Match> Matches;
+};
+
+struct Result {
+  Result() : Ops(0), Nanoseconds(0), Allocations(0), Bytes(0) {}
+
+  uint64_t Ops;
+  uint64_t Nanoseconds;
+  uint64_t Allocations;
+  uint64_t Bytes;
+};
+
+// Runs Body once per pass over all matches. Reset runs between passes and
+// is not measured.
+template <typename BodyFn, typename ResetFn>
+Result measure(const SyntheticSources &Sources, BodyFn Body, ResetFn Reset) {
+  Result R;
+  for (unsigned Pass = 0; Pass < Passes; ++Pass) {
+    Reset();
+    Memory::Phase Phase;
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    for (const Match &M : Sources.matches())
+      Body(M);
+    R.Nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - Start).count();
+    R.Allocations += Phase.allocations();
+    R.Bytes += Phase.allocated();
+    R.Ops += Sources.matches().size();
+  }
+  Reset();
+  return R;
+}
+
+// Runs Body once per pass, after Prepare, which is not measured. An
+// operation is still one match.
+template <typename PrepareFn, typename BodyFn>
+Result measureOnce(const SyntheticSources &Sources, PrepareFn Prepare, BodyFn Body) {
+  Result R;
+  for (unsigned Pass = 0; Pass < Passes; ++Pass) {
+    Prepare();
+    Memory::Phase Phase;
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    Body();
+    R.Nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - Start).count();
+    R.Allocations += Phase.allocations();
+    R.Bytes += Phase.allocated();
+    R.Ops += Sources.matches().size();
+  }
+  return R;
+}
+
+void print(StringRef Name, const Result &R) {
+  double Ops = R.Ops ? R.Ops : 1;
+  outs() << format("%-24s %10llu %10.1f %10.2f %10.1f\n", Name.str().c_str(),
+                   (unsigned long long)R.Ops, R.Nanoseconds / Ops,
+                   R.Allocations / Ops, R.Bytes / Ops);
+}
+} // end namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+  Memory::enable();
+
+  SyntheticSources Sources(Lines, Files ? Files : 1);
+  SourceManager &SM = Sources.sources();
+  std::map<std::string, Replacements> Replace;
+  // Keeps the results alive so the calls are not optimized away.
+  volatile size_t Sink = 0;
+
+  outs() << format("%-24s %10s %10s %10s %10s\n", "benchmark", "ops", "ns/op",
+                   "allocs/op", "bytes/op");
+
+  print("getText", measure(Sources, [&](const Match &M) {
+    Sink += getText(SM, M.Call).size();
+  }, [] {}));
+
+  print("argumentRemovalRange", measure(Sources, [&](const Match &M) {
+    CharSourceRange Range;
+    FileID File;
+    Sink += getArgumentRemovalRange(SM, M.Key, M.Arg, Range, File);
+  }, [] {}));
+
+  print("insertIfdef", measure(Sources, [&](const Match &M) {
+    insertIfdef(&SM, &M.Call, &Replace);
+  }, [&] { Utils::StagedReplacements().clear(); }));
+
+  print("Utils::AddReplacement", measure(Sources, [&](const Match &M) {
+    llvm::consumeError(Utils::AddReplacement(
+        M.Entry, Replacement(SM, M.Call.Start, 4, "methodSignature"), &Replace));
+  }, [&] { Utils::StagedReplacements().clear(); }));
+
+  // Every match staged twice, as a header edit is by each TU that includes
+  // it, and every other match also with a conflicting replacement of a
+  // rule that ranks lower.
+  const std::vector<std::string> RuleOrder = { "bench-first", "bench-second" };
+  print("Utils::MergeStaged", measureOnce(Sources, [&] {
+    Replace.clear();
+    Utils::StagedReplacements().clear();
+    bool Odd = false;
+    for (const Match &M : Sources.matches()) {
+      Replacement Fix(SM, M.Call.Start, 4, "methodSignature");
+      Probes::currentRule() = "bench-first";
+      llvm::consumeError(Utils::AddReplacement(M.Entry, Fix, &Replace));
+      llvm::consumeError(Utils::AddReplacement(M.Entry, Fix, &Replace));
+      if ((Odd = !Odd)) {
+        Probes::currentRule() = "bench-second";
+        llvm::consumeError(Utils::AddReplacement(
+            M.Entry, Replacement(SM, M.Call.Start, 4, "signature"), &Replace));
+      }
+    }
+    Probes::currentRule() = "";
+  }, [&] {
+    Sink += Utils::MergeStaged(RuleOrder, llvm::nulls());
+  }));
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+// Minimal stand-ins for the Qt 4 declarations the porting rules match on,
+// so that the benchmark corpus parses without a Qt installation.
+#ifndef QT4STUB_H
+#define QT4STUB_H
+
+class QString {
+public:
+  QString() {}
+  QString(const char *) {}
+  QString arg(const QString &) const { return *this; }
+};
+
+class QByteArray {
+public:
+  QByteArray(const char *) {}
+};
+
+namespace Qt {
+  QString escape(const QString &plain);
+}
+
+class QMetaMethod {
+public:
+  const char *signature() const;
+};
+
+class QImage {
+public:
+  QString text(const QString &key, const QString &lang = QString()) const;
+  void setText(const QString &key, const QString &lang, const QString &text);
+  int numBytes() const;
+};
+
+class QBasicAtomicInt {
+public:
+  operator int() const;
+};
+
+class QAtomicInt : public QBasicAtomicInt {
+};
+
+#endif
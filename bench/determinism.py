@@ -0,0 +1,171 @@
+#!/usr/bin/env python
+#
+# Determinism check for qt4to5.
+#
+# Generates a corpus in which several rules edit the same code: a -rules file
+# rewrites the Qt::escape() calls -port-qt-escape ports as well, two rules of
+# it rewrite the same numBytes() calls with texts that sort against their
+# rank, and -create-ifdefs puts the #if lines of different rules at the same
+# offsets. A shared header is edited from every TU. Each step is then run in
+# one process with -j1 and -jN, in worker mode (-tu-timeout -jN) and as
+# shards merged with -merge-shards, and the -diff outputs must be identical
+# byte for byte. Exits non-zero on a mismatch.
+#
+# Usage:
+#   determinism.py --qt4to5 build/qt4to5
+
+from __future__ import print_function
+
+import argparse
+import filecmp
+import json
+import multiprocessing
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+STUB = os.path.join(HERE, "corpus", "qt4stub.h")
+
+# Rules that conflict with -port-qt-escape and with each other. The text of
+# the rule ranked second sorts first, so ranking by text would pick it.
+RULES = """\
+- id: escape-as-member
+  match: 'callExpr(callee(functionDecl(hasName("::Qt::escape"))),
+                   hasArgument(0, expr().bind("arg"))).bind("call")'
+  node: call
+  replacement: '(${arg}).toHtmlEscaped()'
+- id: byte-count-b
+  match: 'cxxMemberCallExpr(callee(cxxMethodDecl(hasName("::QImage::numBytes")))).bind("call")'
+  node: call
+  replacement: 'byteCountB()'
+- id: byte-count-a
+  match: 'cxxMemberCallExpr(callee(cxxMethodDecl(hasName("::QImage::numBytes")))).bind("call")'
+  node: call
+  replacement: 'byteCountA()'
+"""
+
+HEADER = """#include "qt4stub.h"
+
+inline QString escapedTitle(const QString &title)
+{
+  return Qt::escape(title);
+}
+"""
+
+UNIT = """#include "shared.h"
+
+void use(const char *);
+void use(const QString &);
+void use(int);
+
+void function%(n)d(const QMetaMethod &m, const QImage &image, QAtomicInt &count)
+{
+  use(m.signature());
+  use(Qt::escape(QString("<b>%(n)d</b>")));
+  use(escapedTitle("%(n)d"));
+  use(image.numBytes()); use(Qt::escape("%(n)d"));
+  use(count + %(n)d);
+}
+"""
+
+# Steps by name; "@rules" stands for the path of the rules file.
+STEPS = [
+  ("rules-conflict", ["-port-qt-escape", "-rules=@rules"]),
+  ("all-rules-ifdefs", ["-port-qmetamethod-signature", "-port-qt-escape", "-port-atomics",
+                        "-rename-class=::QImage", "-rename-old=numBytes", "-rename-new=byteCount",
+                        "-rules=@rules", "-create-ifdefs"]),
+]
+
+
+def generate_corpus(directory, units, functions):
+  shutil.copy(STUB, directory)
+  with open(os.path.join(directory, "shared.h"), "w") as f:
+    f.write(HEADER)
+  with open(os.path.join(directory, "rules.yaml"), "w") as f:
+    f.write(RULES)
+  commands = []
+  for u in range(units):
+    name = os.path.join(directory, "unit%d.cpp" % u)
+    with open(name, "w") as f:
+      for n in range(functions):
+        f.write(UNIT % {"n": u * functions + n})
+    commands.append({
+      "directory": directory,
+      "command": "c++ -std=c++11 -fsyntax-only -I%s %s" % (directory, name),
+      "file": name,
+    })
+  with open(os.path.join(directory, "compile_commands.json"), "w") as f:
+    json.dump(commands, f, indent=1)
+  return [c["file"] for c in commands]
+
+
+def run(command):
+  """Runs command; stderr is shown only if it fails."""
+  process = subprocess.Popen(command, stdout=open(os.devnull, "w"), stderr=subprocess.PIPE)
+  _, stderr = process.communicate()
+  if process.returncode != 0:
+    sys.stderr.write(stderr.decode("utf-8", "replace"))
+    raise RuntimeError("%s failed with status %d" % (" ".join(command), process.returncode))
+
+
+def check_step(qt4to5, flags, directory, files, jobs, shards):
+  """Returns the names of the modes whose diff differs from a -j1 run."""
+  flags = [f.replace("@rules", os.path.join(directory, "rules.yaml")) for f in flags]
+  positional = [directory, directory]
+
+  def diff(name):
+    return os.path.join(directory, name + ".diff")
+
+  run([qt4to5] + flags + ["-j1", "-diff=" + diff("serial")] + positional + files)
+  run([qt4to5] + flags + ["-j%d" % jobs, "-diff=" + diff("parallel")] + positional + files)
+  run([qt4to5] + flags + ["-j%d" % jobs, "-tu-timeout=600", "-diff=" + diff("workers")]
+      + positional + files)
+
+  shard_dir = os.path.join(directory, "shards")
+  os.mkdir(shard_dir)
+  for i in range(shards):
+    run([qt4to5] + flags + ["-shard=%d/%d" % (i, shards), "-shard-dir=" + shard_dir]
+        + positional + files)
+  run([qt4to5, "-merge-shards", "-shard-dir=" + shard_dir, "-diff=" + diff("shards")]
+      + positional)
+
+  if os.path.getsize(diff("serial")) == 0:
+    raise RuntimeError("the -j1 run changed nothing; the corpus no longer matches the rules")
+  return [mode for mode in ("parallel", "workers", "shards")
+          if not filecmp.cmp(diff("serial"), diff(mode), shallow=False)]
+
+
+def check(qt4to5, units=12, functions=4, shards=3):
+  """Runs every step in every mode and returns the number of mismatches."""
+  jobs = max(2, multiprocessing.cpu_count())
+  mismatches = 0
+  for name, flags in STEPS:
+    directory = tempfile.mkdtemp(prefix="qt4to5-determinism-")
+    try:
+      files = generate_corpus(directory, units, functions)
+      different = check_step(qt4to5, flags, directory, files, jobs, shards)
+      mismatches += len(different)
+      print("determinism: %-45s %s" % (name, "MISMATCH with -j1: " + ", ".join(different)
+                                       if different else "ok"))
+    finally:
+      shutil.rmtree(directory)
+  return mismatches
+
+
+def main():
+  parser = argparse.ArgumentParser(description="qt4to5 determinism check")
+  parser.add_argument("--qt4to5", required=True, help="path to the qt4to5 binary")
+  parser.add_argument("--units", type=int, default=12, help="TUs in the corpus")
+  parser.add_argument("--functions", type=int, default=4, help="functions per TU")
+  parser.add_argument("--shards", type=int, default=3, help="shards to split the corpus into")
+  args = parser.parse_args()
+  if check(os.path.abspath(args.qt4to5), args.units, args.functions, args.shards):
+    return 1
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
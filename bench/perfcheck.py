@@ -0,0 +1,236 @@
+#!/usr/bin/env python
+#
+# Performance regression gate for qt4to5.
+#
+# Generates a synthetic corpus, runs every porting step over it several times
+# and runs qt4to5-bench, then compares TUs/sec, peak RSS, time per rule and
+# ns/op of the helpers against bench/baseline.json. A metric regresses when
+# its median is worse than the baseline median by more than both the relative
+# threshold and the noise band (a multiple of the scaled median absolute
+# deviation). A metric without a baseline fails as well. Before measuring, it
+# runs determinism.py. Exits non-zero on a regression, a missing baseline or a
+# mismatch.
+#
+# Usage:
+#   perfcheck.py --qt4to5 build/qt4to5 --bench build/qt4to5-bench
+#   perfcheck.py ... --update-baseline    # record a new baseline
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import determinism
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+BASELINE = os.path.join(HERE, "baseline.json")
+STUB = os.path.join(HERE, "corpus", "qt4stub.h")
+
+# Porting steps run over the corpus, by rule id.
+STEPS = [
+  ("port-qmetamethod-signature", ["-port-qmetamethod-signature"]),
+  ("port-qt-escape", ["-port-qt-escape", "-create-ifdefs"]),
+  ("port-qimage-text", ["-port-qimage-text"]),
+  ("port-atomics", ["-port-atomics"]),
+  ("rename-method", ["-rename-class=::QImage", "-rename-old=numBytes", "-rename-new=byteCount"]),
+]
+
+UNIT = """#include "qt4stub.h"
+
+void use(const char *);
+void use(const QString &);
+void use(int);
+
+void function%(n)d(const QMetaMethod &m, const QImage &image, QImage &target, QAtomicInt &count)
+{
+  use(m.signature());
+  use(Qt::escape(QString("<b>%(n)d</b>")));
+  use(image.text("key%(n)d", 0));
+  target.setText("key%(n)d", 0, "value");
+  use(image.numBytes());
+  use(count + %(n)d);
+}
+"""
+
+
+def generate_corpus(directory, units, functions):
+  shutil.copy(STUB, directory)
+  commands = []
+  for u in range(units):
+    name = os.path.join(directory, "unit%d.cpp" % u)
+    with open(name, "w") as f:
+      for n in range(functions):
+        f.write(UNIT % {"n": u * functions + n})
+    commands.append({
+      "directory": directory,
+      "command": "c++ -std=c++11 -fsyntax-only -I%s %s" % (directory, name),
+      "file": name,
+    })
+  with open(os.path.join(directory, "compile_commands.json"), "w") as f:
+    json.dump(commands, f, indent=1)
+  return [c["file"] for c in commands]
+
+
+def run_with_rusage(command):
+  """Runs command and returns (wall seconds, peak RSS in KB)."""
+  start = time.time()
+  process = subprocess.Popen(command, stdout=open(os.devnull, "w"), stderr=subprocess.PIPE)
+  stderr = process.stderr.read()
+  _, status, usage = os.wait4(process.pid, 0)
+  process.returncode = status
+  if status != 0:
+    sys.stderr.write(stderr.decode("utf-8", "replace"))
+    raise RuntimeError("%s failed with status %d" % (command[0], status))
+  return time.time() - start, usage.ru_maxrss
+
+
+def rule_times(trace_file):
+  """Sums callback spans and matcher times from a -trace file, by rule."""
+  with open(trace_file) as f:
+    events = json.load(f)["traceEvents"]
+  times = {}
+  units = 0
+  for e in events:
+    if e.get("ph") != "X":
+      continue
+    if e["name"] == "Source file":
+      units += 1
+    elif e["name"].endswith("::run"):
+      rule = e["args"]["detail"]
+      times[rule] = times.get(rule, 0.0) + e["dur"] / 1000.0
+    elif e["name"] == "Match":
+      for key, value in e["args"].items():
+        if value.endswith(" ms"):
+          times[key] = times.get(key, 0.0) + float(value[:-3])
+  return times, units
+
+
+def measure_steps(qt4to5, runs, units, functions):
+  samples = {}
+
+  def add(metric, value):
+    samples.setdefault(metric, []).append(value)
+
+  for run in range(runs):
+    for rule, flags in STEPS:
+      directory = tempfile.mkdtemp(prefix="qt4to5-perfcheck-")
+      try:
+        files = generate_corpus(directory, units, functions)
+        trace = os.path.join(directory, "trace.json")
+        seconds, rss = run_with_rusage(
+          [qt4to5] + flags + ["-trace=" + trace, directory, directory] + files)
+        times, parsed = rule_times(trace)
+        add("tus_per_sec/" + rule, parsed / seconds)
+        add("peak_rss_kb/" + rule, rss)
+        add("rule_ms/" + rule, times.get(rule, 0.0))
+      finally:
+        shutil.rmtree(directory)
+  return samples
+
+
+def measure_bench(bench, runs):
+  samples = {}
+  for run in range(runs):
+    output = subprocess.check_output([bench]).decode("utf-8")
+    for line in output.splitlines()[1:]:
+      fields = line.split()
+      if len(fields) == 5:
+        samples.setdefault("ns_per_op/" + fields[0], []).append(float(fields[2]))
+  return samples
+
+
+def median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+
+def mad(values):
+  m = median(values)
+  # Scaled so that it estimates the standard deviation for normal noise.
+  return 1.4826 * median([abs(v - m) for v in values])
+
+
+def higher_is_better(metric):
+  return metric.startswith("tus_per_sec/")
+
+
+def compare(baseline, current, thresholds):
+  """Returns the number of metrics that regressed or have no baseline."""
+  regressions = 0
+  for metric in sorted(current):
+    now = current[metric]
+    base = baseline.get(metric)
+    if base is None:
+      # A gate that passes whatever it measures is no gate.
+      regressions += 1
+      print("perfcheck: %-45s %12.2f  NO BASELINE" % (metric, now["median"]))
+      continue
+    delta = now["median"] - base["median"]
+    if higher_is_better(metric):
+      delta = -delta
+    kind = metric.split("/")[0]
+    allowed = max(thresholds["relative"].get(kind, 0.1) * base["median"],
+                  thresholds["mad_factor"] * max(base["mad"], now["mad"]))
+    status = "ok"
+    if delta > allowed:
+      status = "REGRESSION"
+      regressions += 1
+    print("perfcheck: %-45s %12.2f  baseline %12.2f  allowed +%.2f  %s"
+          % (metric, now["median"], base["median"], allowed, status))
+  return regressions
+
+
+def main():
+  parser = argparse.ArgumentParser(description="qt4to5 performance regression gate")
+  parser.add_argument("--qt4to5", required=True, help="path to the qt4to5 binary")
+  parser.add_argument("--bench", required=True, help="path to the qt4to5-bench binary")
+  parser.add_argument("--baseline", default=BASELINE)
+  parser.add_argument("--runs", type=int, default=5, help="repetitions per measurement")
+  parser.add_argument("--units", type=int, default=50, help="TUs in the corpus")
+  parser.add_argument("--functions", type=int, default=40, help="functions per TU")
+  parser.add_argument("--update-baseline", action="store_true",
+                      help="write the measurements as the new baseline")
+  args = parser.parse_args()
+
+  with open(args.baseline) as f:
+    baseline = json.load(f)
+
+  qt4to5 = os.path.abspath(args.qt4to5)
+  if determinism.check(qt4to5):
+    print("perfcheck: the output depends on how the run is split up")
+    return 1
+
+  samples = measure_steps(qt4to5, args.runs, args.units, args.functions)
+  samples.update(measure_bench(os.path.abspath(args.bench), args.runs))
+  current = dict((metric, {"median": median(values), "mad": mad(values)})
+                 for metric, values in samples.items())
+
+  if args.update_baseline:
+    baseline["metrics"] = current
+    baseline["corpus"] = {"units": args.units, "functions": args.functions, "runs": args.runs}
+    with open(args.baseline, "w") as f:
+      json.dump(baseline, f, indent=2, sort_keys=True)
+      f.write("\n")
+    print("perfcheck: wrote %s" % args.baseline)
+    return 0
+
+  regressions = compare(baseline.get("metrics", {}), current, baseline["thresholds"])
+  if regressions:
+    print("perfcheck: %d regressions or metrics without a baseline" % regressions)
+    if not baseline.get("metrics"):
+      print("perfcheck: %s has no measurements; record them with --update-baseline" % args.baseline)
+    return 1
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -83,6 +83,46 @@ def portQImageText():
   execCommand("git grep -l \"setText(.\\+0.\\+)\" | xargs " + qt4to5Binary + " -port-qimage-text " + os.getcwd() + " " + os.getcwd() + "/porting")
   createCommit("Port uses of QImage::text and QImage::setText.")
 
+def portQStringArgChains():
+  execCommand("git grep -l \"\\.arg(\" | xargs " + qt4to5Binary + " -port-qstring-arg " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Collapse chains of QString::arg calls")
+
+def portQStringRefs():
+  execCommand("git grep -lE \"\\.(mid|left|right|split)\\(\" | xargs " + qt4to5Binary + " -port-qstringref -create-ifdefs " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Use QStringRef for substrings that are only read")
+
+def portReserve():
+  execCommand("git grep -lE \"\\bfor\\s*\\(\" | xargs " + qt4to5Binary + " -port-reserve " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Reserve room in containers filled by counted loops")
+
+def portQHash():
+  execCommand("git grep -lw QMap | xargs " + qt4to5Binary + " -port-qhash " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Use QHash for maps whose order is never used")
+
+def portSequences():
+  execCommand("git grep -lwE \"QLinkedList|QList\" | xargs " + qt4to5Binary + " -port-sequences " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Use the container that suits how each list is accessed")
+
+def portQObjectCasts():
+  execCommand("git grep -lwE \"dynamic_cast|typeid\" | xargs " + qt4to5Binary + " -port-qobject-cast " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Use qobject_cast for casts between QObject classes")
+
+def portElapsedTimers():
+  execCommand("git grep -lwE \"QTime|QDateTime\" | xargs " + qt4to5Binary + " -port-elapsed-timer " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Measure elapsed time with a monotonic clock")
+
+def portSignalMappers():
+  execCommand("git grep -lwE \"QSignalMapper|sender\" | xargs " + qt4to5Binary + " -port-signal-mapper " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Connect to lambdas instead of QSignalMapper")
+
+def portMakeShared():
+  execCommand("git grep -lwE \"QSharedPointer|shared_ptr\" | xargs " + qt4to5Binary + " -port-make-shared " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Allocate shared objects together with their reference count")
+
+def portMetaTypes():
+  execCommand("git grep -lwE \"QMetaType|qRegisterMetaType|Q_ENUMS\" | xargs " + qt4to5Binary + " -port-metatypes " + os.getcwd() + " " + os.getcwd() + "/porting")
+  createCommit("Look up meta types once instead of by name")
+
 ## Pre-porting steps. These can be done before porting to Qt 5 (eg port away from deprecated methods).
 
 def portFromQt3Support():
@@ -132,9 +172,24 @@ def portFromQt5Deprecated():
   renameMethod("QSslCertificate", "alternateSubjectNames", "subjectAlternativeNames")
 
 
+## Optimizations. Where they need newer Qt API, the old code is kept behind #if.
+
+def optimize():
+  portQStringArgChains()
+  portQStringRefs()
+  portReserve()
+  portQHash()
+  portSequences()
+  portQObjectCasts()
+  portElapsedTimers()
+  portSignalMappers()
+  portMakeShared()
+  portMetaTypes()
+
 # These function invokations do the actual porting.
 
 portFromQt3Support()
 portFromQt4Deprecated()
 port4to5()
 portFromQt5Deprecated()
+optimize()